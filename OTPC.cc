@@ -25,6 +25,7 @@
 ////////////////////////////////////////////////////////////////
 
 #include "G4RunManager.hh"
+#include "G4RunManagerFactory.hh"
 #include "G4UImanager.hh"
 #include "G4UIterminal.hh"
 
@@ -43,6 +44,14 @@
 #include "OTPCRunAction.hh"
 #include "OTPCEventAction.hh"
 #include "OTPCSteppingAction.hh"
+#include "OTPCActionInitialization.hh"
+#include "OTPCRunConfiguration.hh"
+#include "OTPCJobServer.hh"
+#include "OTPCSweepQueue.hh"
+#include "OTPCCheckpoint.hh"
+#include "OTPCReplay.hh"
+#include "OTPCResultCache.hh"
+#include "OTPCPhiloxEngine.hh"
 
 #include "Randomize.hh"
 #include "globals.hh"
@@ -57,8 +66,14 @@
 #include <format>
 #include <algorithm>
 #include <numeric>
+#include <limits>
 #include "utilities.h"
 
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
 #include <boost/program_options.hpp>
 #include <boost/units/systems/si.hpp>
 #include <boost/units/io.hpp>
@@ -71,7 +86,9 @@ int main(int argc, char** argv) {
 		isDense = false,
 		skipIfDataExists = false,
 		dataOverwrite = false,
-		loadDataFromFile = false;
+		loadDataFromFile = false,
+		useTasking = true,
+		parallelEnergies = false;
 	G4double
 		crystalDepth = 10 * cm,
 		cutValue = 0.01 * mm;
@@ -79,28 +96,48 @@ int main(int argc, char** argv) {
 		scintillatorType = "CeBr3",
 		physicsListName = "emlivermore",
 		positionalArg,
+		homeDirectoryArg,
+		serverSocketPath,
 		additionalInfo = "";
 	uint64_t
 		numberOfEvent = 1000000,
 		eventsSliceSize = 1000000,
-		Z_offset = 0;
+		Z_offset = 0,
+		numberOfThreads = 0,
+		numberOfProcesses = 0;
 	const uint64_t
 		Z_max_offset = 4;
 	G4ThreeVector
 		particleInitialPosition;
+	G4long
+		Seed = G4long(OTPCPhiloxEngine::makeRunSeed());
+	std::string
+		queueDirectory,
+		sweepPlanPath,
+		resumeDirectory,
+		triggerPath,
+		stackingPath,
+		replayDirectory,
+		replaySelection,
+		streamName,
+		streamPolicy,
+		voxelShape;
+	OTPCSummarySettings summarySettings;
+	uint64_t
+		leaseDuration = 600,
+		streamCapacity = 65536;
+	bool
+		compactEncoding = false,
+		storeResults = false,
+		rangeCut = false;
+	double
+		rangeCutTolerance = 0,
+		fixedPointStep = 0,
+		voxelStep = 0.01,
+		voxelFileSize = 1024;
 
 	auto start = std::chrono::high_resolution_clock::now();
 
-	std::filesystem::path homeDirectory = "C:\\Users\\26kub";
-	if (!std::filesystem::exists(homeDirectory)) {
-		std::cout << "Set correct home directory!" << _endl_;
-		exit(1);
-	}
-	auto resultsDirectoryPath = homeDirectory / "results_TPC";
-	if (!std::filesystem::exists(resultsDirectoryPath)) {
-		std::filesystem::create_directory(resultsDirectoryPath);
-	}
-
 	po::options_description desc("Allowed options");
 	desc.add_options()
 		("help", "produce help message")
@@ -110,10 +147,44 @@ int main(int argc, char** argv) {
 		("depth", po::value<double>(&crystalDepth), "crystal depth (in cm)")
 		("physics", po::value<std::string>(&physicsListName)->default_value("emlivermore"), "physics list name")
 		("cut", po::value<double>(&cutValue), "cut value (in mm)")
+		("range_cut", po::value<bool>(&rangeCut)->default_value(false), "electrons whose CSDA range is shorter than the distance to the volume boundary deposit their energy at once")
+		("range_tolerance", po::value<double>(&rangeCutTolerance)->default_value(0), "CSDA range below which electrons deposit their energy at once anywhere (in mm)")
 		("skip", po::value<bool>(&skipIfDataExists)->default_value(false), "skip if data exists")
 		("positional", po::value<std::string>(&positionalArg), "positional argument")
 		("load", po::value<bool>(&loadDataFromFile)->default_value(false), "load data from file")
-		("Z_off", po::value<uint64_t>(&Z_offset), "particle offset in Z axis");
+		("Z_off", po::value<uint64_t>(&Z_offset), "particle offset in Z axis")
+		("threads", po::value<uint64_t>(&numberOfThreads)->default_value(0), "number of worker threads (0 - sequential run manager)")
+		("tasking", po::value<bool>(&useTasking)->default_value(true), "use task-based run manager instead of MT one")
+		("parallel_energies", po::value<bool>(&parallelEnergies)->default_value(false), "simulate all energies concurrently in one run")
+		("fork", po::value<uint64_t>(&numberOfProcesses)->default_value(0), "number of worker processes forked after initialization (Linux only)")
+		("home", po::value<std::string>(&homeDirectoryArg)->default_value("C:\\Users\\26kub"), "home directory, results are saved in its results_TPC subdirectory")
+		("server", po::value<std::string>(&serverSocketPath), "serve simulation jobs on this UNIX socket instead of running the energy list (Linux only)")
+		("seed", po::value<G4long>(&Seed), "random seed (default: drawn from std::random_device)")
+		("queue", po::value<std::string>(&queueDirectory), "shared queue directory, run queued sweep units until the sweep is finished")
+		("plan", po::value<std::string>(&sweepPlanPath), "sweep plan to expand into work units of --queue")
+		("lease", po::value<uint64_t>(&leaseDuration)->default_value(600), "lease duration of queue work units (in s)")
+		("store", po::value<bool>(&storeResults)->default_value(false), "keep results in the store of results_TPC keyed by the configuration, simulate only events missing there")
+		("resume", po::value<std::string>(&resumeDirectory), "run directory of an interrupted simulation to continue from its last checkpoint")
+		("compact", po::value<bool>(&compactEncoding)->default_value(false), "write only crystals with a deposit and quantized primary info")
+		("fixed_point", po::value<double>(&fixedPointStep)->default_value(0), "deposit precision of --compact output (in keV, 0 - float32)")
+		("trigger", po::value<std::string>(&triggerPath), "trigger conditions file, only accepted events are written")
+		("stacking", po::value<std::string>(&stackingPath), "stacking rules file, new tracks matching a rule are killed, deposited at once, deferred or tracked")
+		("replay", po::value<std::string>(&replayDirectory), "run directory whose selected events are simulated again with full step detail (same options as the run)")
+		("stream", po::value<std::string>(&streamName), "publish written events to this POSIX shared memory segment for a live consumer (Linux only)")
+		("stream_capacity", po::value<uint64_t>(&streamCapacity)->default_value(65536), "records buffered per worker in the stream")
+		("stream_policy", po::value<std::string>(&streamPolicy)->default_value("drop"), "full stream: \"block\" waits for the consumer, \"drop\" drops the event from the stream")
+		("summary", po::value<bool>(&summarySettings.enabled)->default_value(true), "accumulate efficiencies and spectra during the run, written as summary_<energy>keV.json")
+		("summary_threshold", po::value<double>(&summarySettings.threshold)->default_value(10), "deposit a crystal needs to count as hit in the summary (in keV)")
+		("peak_window", po::value<double>(&summarySettings.peakWindow)->default_value(1), "half width of the full-energy peak around the primary energy (in keV)")
+		("summary_bin", po::value<double>(&summarySettings.binWidth)->default_value(1), "bin width of the summed crystal spectrum (in keV)")
+		("summary_max", po::value<double>(&summarySettings.maximum)->default_value(6000), "upper edge of the summed crystal spectrum (in keV)")
+		("gas_bin", po::value<double>(&summarySettings.gasBinWidth)->default_value(0.1), "bin width of the gas deposit spectrum (in keV)")
+		("gas_max", po::value<double>(&summarySettings.gasMaximum)->default_value(200), "upper edge of the gas deposit spectrum (in keV)")
+		("coincidence_bin", po::value<double>(&summarySettings.coincidenceBinWidth)->default_value(1), "deposit bin width of the crystal coincidence matrix of the summary (in keV, 0 - no matrix)")
+		("voxels", po::value<std::string>(&voxelShape), "export gas deposits of the written events on a voxel grid \"nx,ny,nz\" over the active volume as voxels_*.vox")
+		("voxel_step", po::value<double>(&voxelStep)->default_value(0.01), "quantization step of the voxel deposits (in keV)")
+		("voxel_file_size", po::value<double>(&voxelFileSize)->default_value(1024), "size after which a new voxel file is started (in MB)")
+		("replay_events", po::value<std::string>(&replaySelection)->default_value("accepted"), "events to replay: file of \"energy(MeV) event\" lines, or \"accepted\" for all events accepted by the trigger");
 
 	po::variables_map vm;
 	po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -130,12 +201,32 @@ int main(int argc, char** argv) {
 		crystalDepth *= cm;
 	}
 
-	// Choose the random engine and initialize
-	CLHEP::HepRandom::setTheEngine(new CLHEP::RanluxEngine);
+	std::filesystem::path homeDirectory = homeDirectoryArg;
+	if (!std::filesystem::exists(homeDirectory)) {
+		std::cout << "Set correct home directory!" << _endl_;
+		exit(1);
+	}
+	auto resultsDirectoryPath = homeDirectory / "results_TPC";
+	if (!std::filesystem::exists(resultsDirectoryPath)) {
+		std::filesystem::create_directory(resultsDirectoryPath);
+	}
 
-	G4long Seed = 2193585;
-	G4int Lux = 3;
-	CLHEP::HepRandom::setTheSeed(Seed, Lux);
+	if (vm.count("queue")) { // queue driver, every work unit is run as a separate OTPC process
+		OTPCSweepQueue sweepQueue(queueDirectory, std::chrono::seconds(leaseDuration));
+		if (vm.count("plan")) {
+			sweepQueue.enqueuePlan(sweepPlanPath, Seed);
+			return 0;
+		}
+		return sweepQueue.drain(argv[0], std::format("--home \"{}\"", homeDirectory.string())) == 0 ? 0 : 1;
+	}
+
+	// Choose the random engine and initialize
+	// random seed drawn per job unless given (it must change from one run to another!!! otherwise we simulate all the time the same in the OTPC case!!)
+	// events draw from per-event Philox streams keyed by this seed (see OTPCPrimaryGeneratorAction),
+	// the master engine only serves the run manager's own bookkeeping
+	CLHEP::HepRandom::setTheEngine(new CLHEP::RanecuEngine);
+	CLHEP::HepRandom::setTheSeed(Seed);
+	std::cout << "Random seed: " << Seed << '\n';
 
 	checkpoint;
 #ifdef  WIN32
@@ -148,35 +239,67 @@ int main(int argc, char** argv) {
 	_putenv_s("G4LEDATA", "C:\\Program Files (x86)\\Geant4 10.5\\data\\G4EMLOW7.7");
 	system("set G4LEDATA");
 #endif //  WIN32
-	// construct the default run manager
-	std::unique_ptr<G4RunManager> runManager = std::make_unique<G4RunManager>();
+	// construct the run manager, sequential unless worker threads were requested
+	auto runManagerType = G4RunManagerType::Serial;
+	if (numberOfThreads > 0) {
+		runManagerType = useTasking ? G4RunManagerType::Tasking : G4RunManagerType::MT;
+	}
+	std::unique_ptr<G4RunManager> runManager(G4RunManagerFactory::CreateRunManager(runManagerType));
+	if (numberOfThreads > 0) {
+		runManager->SetNumberOfThreads(numberOfThreads);
+	}
 
 	checkpoint;
 	// set mandatory initialization classes
 	auto OTPCdetector = new OTPCDetectorConstruction(crystalDepth, scintillatorType);
 	runManager->SetUserInitialization(OTPCdetector);
 	auto OTPCphysList = new OTPCPhysicsList(physicsListName);
+	OTPCphysList->setRangeCut(rangeCut, rangeCutTolerance * mm);
 	runManager->SetUserInitialization(OTPCphysList);
 
 	checkpoint;
-	// set aditional user action classes
-	OTPCRunAction* OTPCrun = new OTPCRunAction;
-	runManager->SetUserAction(OTPCrun);
-	OTPCEventAction* OTPCevent = new OTPCEventAction(OTPCrun);
-	runManager->SetUserAction(OTPCevent);
-	OTPCSteppingAction* OTPCstep = new OTPCSteppingAction(OTPCevent, OTPCdetector->getScintillatorType());
-	runManager->SetUserAction(OTPCstep);
+	// settings shared by all threads, changed only between runs
+	OTPCRunConfiguration runConfiguration(loadDataFromFile);
+	runConfiguration.setRunSeed(Seed);
+	runConfiguration.setCompactEncoding(compactEncoding, fixedPointStep);
+	runConfiguration.setSummarySettings(summarySettings);
+	// replayed events are traced step by step; decided before the actions are built
+	runConfiguration.setStepCapture(vm.count("replay") > 0);
+	OTPCdetector->setRunConfiguration(runConfiguration);
+	if (vm.count("trigger")) {
+		OTPCTrigger trigger;
+		trigger.load(triggerPath);
+		runConfiguration.setTrigger(trigger);
+	}
+	if (vm.count("stacking")) {
+		OTPCStackingRules stackingRules;
+		stackingRules.load(stackingPath);
+		runConfiguration.setStackingRules(stackingRules);
+	}
+
+	// one ring per worker thread or forked worker, created before forking so that all processes share it
+	std::unique_ptr<OTPCEventStream> eventStream;
+	if (vm.count("stream")) {
+		auto producers = std::max<uint64_t>({ numberOfThreads, numberOfProcesses, 1 });
+		eventStream = std::make_unique<OTPCEventStream>(streamName, producers, streamCapacity, OTPCEventStream::parsePolicy(streamPolicy));
+		runConfiguration.setEventStream(eventStream.get());
+	}
 
 	checkpoint;
-	// set mandatory user action class
-	OTPCPrimaryGeneratorAction*
-		OTPCgun = new OTPCPrimaryGeneratorAction(OTPCrun, loadDataFromFile);
-	runManager->SetUserAction(OTPCgun);
+	// set user action classes, built per worker thread in MT mode
+	runManager->SetUserInitialization(new OTPCActionInitialization(runConfiguration));
 
 	checkpoint;
 	// initialize G4 kernel
 	runManager->Initialize();
 
+	if (vm.count("voxels")) {
+		// grid covers the whole gas volume, known once the geometry is constructed
+		auto halfSize = OTPCdetector->getActiveVolumeHalfSize() / mm;
+		OTPCVoxelGrid voxelGrid(OTPCVoxelGrid::parseShape(voxelShape), { -halfSize.x(), -halfSize.y(), -halfSize.z() }, { halfSize.x(), halfSize.y(), halfSize.z() }, voxelStep);
+		runConfiguration.setVoxelExport(voxelGrid, uint64_t(voxelFileSize * 1024 * 1024));
+	}
+
 	// Visualization, if you choose to have it!
 #ifdef G4VIS_USE
 //   G4VisManager* visManager = new OTPCVisManager;
@@ -187,12 +310,22 @@ int main(int argc, char** argv) {
 #endif
 	OTPCphysList->SetDefaultCutValue(cutValue);
 
+	if (vm.count("server")) {
+		if (numberOfProcesses > 0) {
+			std::cout << "--server and --fork are mutually exclusive arguments\n";
+			return 1;
+		}
+		// jobs define their own energy, position and output directory
+		OTPCJobServer jobServer(runManager.get(), runConfiguration, serverSocketPath);
+		return jobServer.run();
+	}
+
 	std::vector<G4double> energies;
 	if (isDense) {
 		energies = nums(100 * keV, 5000 * keV, 250);
 	}
 	else if (loadDataFromFile) {
-		energies.push_back(0); // add dummy value to do one run loop
+		energies.push_back(runConfiguration.getEnergy()); // energy loaded from file, used to do one run loop
 	}
 	else {
 		energies = {
@@ -214,6 +347,14 @@ int main(int argc, char** argv) {
 			5000 * keV };
 	}
 
+	if (numberOfProcesses > 0) {
+		if (numberOfThreads > 0) {
+			std::cout << "--fork and --threads are mutually exclusive arguments\n";
+			return 1;
+		}
+		parallelEnergies = true; // forked workers run all energies in one run so the parent merges once
+	}
+
 	if (vm.count("positional") && vm.count("Z_off")) {
 		std::cout << "--positional and --Z_off are mutually exclusive arguments\n";
 		return 1;
@@ -230,7 +371,7 @@ int main(int argc, char** argv) {
 			corner.getY() * yPositionSetting,
 			corner.getZ() * zPositionSetting
 		};
-		OTPCgun->setPosition(particleInitialPosition);
+		runConfiguration.setPosition(particleInitialPosition);
 		additionalInfo += std::format("_{}", positionalArg);
 	}
 	
@@ -246,7 +387,7 @@ int main(int argc, char** argv) {
 			0,
 			corner.getZ() * Z_offset / Z_max_offset
 		};
-		OTPCgun->setPosition(particleInitialPosition);
+		runConfiguration.setPosition(particleInitialPosition);
 		additionalInfo += std::format("_Z{}({})", Z_offset, Z_max_offset);
 	}
 
@@ -268,45 +409,300 @@ int main(int argc, char** argv) {
 
 	checkpoint;
 
-	// find first available simulation index
-	for (int i = 0;; i++) {
-		runDirectoryName = std::format("event_{}_{}",
-			paramString,
-			i);
-		runDirectoryPath = resultsDirectoryPath / runDirectoryName;
-		if (std::filesystem::exists(runDirectoryPath) && skipIfDataExists) {
-			std::cout << "Data exists. Aborting simulation." << _endl_;
-			return 0; // data exists, exit program
+	if (vm.count("replay") && (vm.count("resume") || numberOfProcesses > 0)) {
+		std::cout << "--replay cannot be combined with --resume or --fork\n";
+		return 1;
+	}
+
+	if (storeResults && (vm.count("replay") || vm.count("resume"))) {
+		std::cout << "--store cannot be combined with --replay or --resume\n";
+		return 1;
+	}
+
+	// every input that changes the results, see OTPCResultCache
+	OTPCResultCache resultCache(resultsDirectoryPath / "store");
+	if (storeResults) {
+		auto& position = runConfiguration.getPosition();
+		resultCache.add("code", OTPC_CODE_VERSION);
+		resultCache.add("scintillator", OTPCdetector->getScintillatorType());
+		resultCache.add("depth_cm", std::format("{}", OTPCdetector->getCrystalDepth() / cm));
+		resultCache.add("physics", OTPCphysList->getPhysicsListName());
+		resultCache.add("cut_mm", std::format("{}", OTPCphysList->GetCutValue(pname) / mm));
+		resultCache.add("range_cut", std::format("{} {}", rangeCut, rangeCutTolerance));
+		resultCache.addFile("geometry", OTPCDetectorConstruction::getGeometryFilePath());
+		resultCache.addMaterials();
+		resultCache.add("source_types", std::format("{} {} {}", runConfiguration.getParticleType(0), runConfiguration.getParticleType(1), runConfiguration.getParticleType(2)));
+		resultCache.add("source_position_mm", std::format("{} {} {}", position.getX() / mm, position.getY() / mm, position.getZ() / mm));
+		if (loadDataFromFile) {
+			resultCache.addFile("particles", OTPCRunConfiguration::getParticleFilePath());
+		}
+		resultCache.add("compact", std::format("{} {}", compactEncoding, fixedPointStep));
+		if (vm.count("trigger")) {
+			resultCache.addFile("trigger", triggerPath);
+		}
+		if (vm.count("stacking")) {
+			resultCache.addFile("stacking", stackingPath);
+		}
+		resultCache.add("summary", std::format("{} {} {} {} {} {} {} {}", summarySettings.enabled, summarySettings.threshold, summarySettings.peakWindow,
+			summarySettings.binWidth, summarySettings.maximum, summarySettings.gasBinWidth, summarySettings.gasMaximum, summarySettings.coincidenceBinWidth));
+		if (vm.count("voxels")) {
+			// file size only splits the output, it does not change the exported events
+			resultCache.add("voxels", std::format("{} {}", voxelShape, voxelStep));
 		}
-		if (!std::filesystem::exists(runDirectoryPath) || dataOverwrite) {
-			break; // index found
+	}
+
+	OTPCReplay runReplay(replayDirectory);
+	if (vm.count("replay")) {
+		// replayed events get the streams of the original run and their own output directory
+		runDirectoryPath = runReplay.getReplayPath();
+		std::filesystem::create_directories(runDirectoryPath);
+		runConfiguration.setRunSeed(runReplay.loadRunSeed());
+		if (replaySelection == "accepted") {
+			runReplay.selectAccepted();
+		}
+		else {
+			runReplay.loadSelection(replaySelection);
+		}
+	}
+	else if (vm.count("resume")) {
+		if (numberOfProcesses > 0) {
+			std::cout << "--resume and --fork are mutually exclusive arguments\n";
+			return 1;
+		}
+		runDirectoryPath = resumeDirectory;
+		if (!std::filesystem::is_directory(runDirectoryPath)) {
+			std::cout << "Run directory to resume does not exist" << _endl_;
+			return 1;
+		}
+	}
+	else if (storeResults) {
+		runDirectoryPath = resultCache.open();
+	}
+	else {
+		// find first available simulation index
+		for (int i = 0;; i++) {
+			runDirectoryName = std::format("event_{}_{}",
+				paramString,
+				i);
+			runDirectoryPath = resultsDirectoryPath / runDirectoryName;
+			if (std::filesystem::exists(runDirectoryPath) && skipIfDataExists) {
+				std::cout << "Data exists. Aborting simulation." << _endl_;
+				return 0; // data exists, exit program
+			}
+			// create_directory is atomic, so processes started together never share an index
+			if (std::filesystem::create_directory(runDirectoryPath) || dataOverwrite) {
+				break; // index found
+			}
 		}
 	}
-	std::filesystem::create_directory(runDirectoryPath);
 	OTPCdetector->saveDetails(runDirectoryPath);
-	OTPCgun->setRunPath(runDirectoryPath);
+	runConfiguration.setRunPath(runDirectoryPath);
+	if ((dataOverwrite && !vm.count("resume") && !storeResults) || vm.count("replay")) {
+		// container is appended run by run, events of a previous job must not be mixed in
+		std::filesystem::remove(OTPCRunAction::getContainerPath(runConfiguration));
+		std::filesystem::remove(OTPCRunAction::getStepTracePath(runConfiguration));
+		std::filesystem::remove(OTPCRunAction::getSummaryPath(runConfiguration));
+		std::filesystem::remove(OTPCRunAction::getTriggerSummaryPath(runConfiguration));
+		std::filesystem::remove(OTPCRunAction::getStackingSummaryPath(runConfiguration));
+		for (const auto& entry : std::filesystem::directory_iterator(runDirectoryPath)) {
+			if (entry.path().extension() == ".vox") {
+				std::filesystem::remove(entry.path());
+			}
+		}
+	}
 
-	checkpoint;
-	// iterate over energies
-	for (auto energy : energies) {
-		if (!loadDataFromFile) { // when loading from file dummy energy value is used once in the loop
-			OTPCgun->setEnergy(energy); //set energy for each run
+	// progress is saved after every slice, interrupted run continues after the last saved slice
+	OTPCCheckpoint runCheckpoint(runDirectoryPath);
+	if (vm.count("resume")) {
+		// continued events must come from the streams of the interrupted run
+		if (runCheckpoint.load()) {
+			runConfiguration.setRunSeed(runCheckpoint.getRunSeed());
 		}
+		else {
+			// interrupted before the first slice, the seed was recorded when the run started
+			OTPCReplay interruptedRun(runDirectoryPath);
+			if (interruptedRun.hasRunSeed()) {
+				runConfiguration.setRunSeed(interruptedRun.loadRunSeed());
+			}
+			else if (!vm.count("seed")) {
+				std::cout << "No checkpoint and no run seed in the run directory, give the seed of the interrupted run with --seed" << _endl_;
+				return 1;
+			}
+		}
+		runCheckpoint.restore();
+	}
+	else if (storeResults && runCheckpoint.load()) {
+		// output of an interrupted job is cut back to its last slice, missing events continue the stored streams
+		runCheckpoint.restore();
+		runConfiguration.setRunSeed(runCheckpoint.getRunSeed());
+	}
+	// events already stored per energy, energies with all events stored are not simulated again
+	if (storeResults) {
+		std::erase_if(energies, [&](G4double energy) {
+			auto completed = runCheckpoint.getEnergyProgress(energy / keV);
+			if (completed > 0) {
+				std::cout << std::format("{} keV: {} events stored\n", energy / keV, completed);
+			}
+			return completed >= numberOfEvent;
+		});
+		if (energies.empty()) {
+			std::cout << "All events are stored" << '\n';
+			return 0;
+		}
+		auto storedEvents = runCheckpoint.getEnergyProgress(energies.front() / keV);
+		bool sameProgress = std::all_of(energies.begin(), energies.end(), [&](G4double energy) {
+			return runCheckpoint.getEnergyProgress(energy / keV) == storedEvents;
+		});
+		// energies of one run continue from the same event
+		if (parallelEnergies && !sameProgress) {
+			std::cout << "Stored energies have different numbers of events, they are run one after another\n";
+			parallelEnergies = false;
+		}
+	}
+	if (!vm.count("replay")) {
+		// enough to simulate any event of the run again, see OTPCReplay
+		OTPCReplay(runDirectoryPath).saveRunSeed(runConfiguration.getRunSeed());
+	}
+	bool saveCheckpoints = numberOfProcesses == 0;
+
+	checkpoint;
+	auto energyPointFor = [&](G4double energy) {
 		auto partialFileName = std::format("event_{}keV_{}_",
-			OTPCgun->getEnergy() / keV,
+			energy / keV,
 			paramString);
 		auto eventTotalDepositFileName = partialFileName + "totalDeposit";
 		auto eventStepsDepositFileName = partialFileName + "stepsDeposit";
-		auto eventTotalDepositFilePath = runDirectoryPath / eventTotalDepositFileName;
-		auto eventStepsDepositFilePath = runDirectoryPath / eventStepsDepositFileName;
-		OTPCrun->setEventFilePath(eventTotalDepositFilePath, eventStepsDepositFilePath);
-		checkpoint;
-		// start a run
-		for (uint64_t eventCount = 0; eventCount < numberOfEvent; eventCount += eventsSliceSize) {
-			auto runEventNumber = std::min(eventsSliceSize, numberOfEvent - eventCount);
-			runManager->BeamOn(runEventNumber);
-			std::cout << std::format("Events finished {}/{}\n", std::min(eventCount + eventsSliceSize, numberOfEvent), numberOfEvent);
+		return OTPCEnergyPoint{ energy, runDirectoryPath / eventTotalDepositFileName, runDirectoryPath / eventStepsDepositFileName };
+	};
+
+	// run in slices, every energy point of a run gets the same number of events per slice
+	auto runSlices = [&](uint64_t energyPointsPerRun, uint64_t setupIndex, uint64_t firstEvent, uint64_t lastEvent) {
+		for (uint64_t eventCount = firstEvent; eventCount < lastEvent; eventCount += eventsSliceSize) {
+			auto runEventNumber = std::min(eventsSliceSize, lastEvent - eventCount);
+			if (runEventNumber * energyPointsPerRun > uint64_t(std::numeric_limits<G4int>::max())) {
+				std::cout << "Too many events in one run, decrease --slice" << _endl_;
+				exit(1);
+			}
+			runConfiguration.setEventNumbering(eventCount, numberOfEvent);
+			runManager->BeamOn(G4int(runEventNumber * energyPointsPerRun));
+			std::cout << std::format("Events finished {}/{}\n", eventCount + runEventNumber - firstEvent, lastEvent - firstEvent);
+			if (saveCheckpoints) {
+				for (std::size_t energyIndex = 0; energyIndex < runConfiguration.getNumberOfEnergyPoints(); energyIndex++) {
+					runCheckpoint.setEnergyProgress(runConfiguration.getEnergyPoint(energyIndex).energy / keV, eventCount + runEventNumber);
+				}
+				runCheckpoint.save(setupIndex, eventCount + runEventNumber, runConfiguration.getRunSeed());
+			}
+		}
+	};
+
+	// calls runEnergies once per run configuration (setup): once for all energies or once per energy
+	auto forEachEnergySetup = [&](auto&& runEnergies) {
+		if (parallelEnergies) {
+			// all energies in one run, events are distributed round-robin over the energy points
+			std::vector<OTPCEnergyPoint> energyPoints;
+			for (auto energy : energies) {
+				energyPoints.push_back(energyPointFor(energy));
+			}
+			runConfiguration.setEnergySweep(energyPoints);
+			runEnergies(energyPoints.size(), 0);
+		}
+		else {
+			// iterate over energies
+			for (uint64_t setupIndex = 0; setupIndex < energies.size(); setupIndex++) {
+				runConfiguration.setEnergy(energies[setupIndex]); //set energy for each run
+				auto energyPoint = energyPointFor(energies[setupIndex]);
+				runConfiguration.setEventFilePath(energyPoint.eventTotalDepositFilePath, energyPoint.eventStepsDepositFilePath);
+				checkpoint;
+				runEnergies(1, setupIndex);
+			}
+		}
+	};
+
+	if (vm.count("replay")) {
+		// one run per energy with only the selected events, all of them written to the step trace
+		for (const auto& [energy, eventNumbers] : runReplay.getSelection()) {
+			runConfiguration.setEnergy(energy);
+			auto energyPoint = energyPointFor(energy);
+			runConfiguration.setEventFilePath(energyPoint.eventTotalDepositFilePath, energyPoint.eventStepsDepositFilePath);
+			runConfiguration.setReplayEvents(eventNumbers);
+			runManager->BeamOn(G4int(eventNumbers.size()));
+			std::cout << std::format("Replayed {} events of {} keV\n", eventNumbers.size(), energy / keV);
+		}
+		return 0;
+	}
+
+	if (numberOfProcesses > 0) {
+#ifdef __linux__
+		// build physics tables before forking so that workers inherit them copy-on-write
+		runManager->BeamOn(0);
+		std::cout.flush();
+
+		std::vector<pid_t> workers;
+		for (uint64_t workerIndex = 0; workerIndex < numberOfProcesses; workerIndex++) {
+			pid_t pid = fork();
+			if (pid < 0) {
+				std::cout << "fork failed" << _endl_;
+				exit(1);
+			}
+			if (pid == 0) {
+				// worker: own event slice, output shards are merged by the parent;
+				// random streams are keyed by event number, so workers share the run seed
+				runConfiguration.setForkedWorker(workerIndex);
+				forEachEnergySetup([&](uint64_t energyPointsPerRun, uint64_t setupIndex) {
+					// workers share the events missing in the store, all of them without --store;
+					// energies of one setup have the same stored progress, see above
+					uint64_t storedEvents = storeResults ? runCheckpoint.getEnergyProgress(runConfiguration.getEnergyPoint(0).energy / keV) : 0;
+					auto firstEvent = storedEvents + (numberOfEvent - storedEvents) * workerIndex / numberOfProcesses;
+					auto lastEvent = storedEvents + (numberOfEvent - storedEvents) * (workerIndex + 1) / numberOfProcesses;
+					runSlices(energyPointsPerRun, setupIndex, firstEvent, lastEvent);
+				});
+				std::cout.flush();
+				_exit(0);
+			}
+			workers.push_back(pid);
+		}
+
+		bool workersSucceeded = true;
+		for (auto pid : workers) {
+			int status;
+			waitpid(pid, &status, 0);
+			workersSucceeded &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		}
+		if (!workersSucceeded) {
+			std::cout << "Worker process failed, shards are left unmerged" << _endl_;
+			return 1;
 		}
+		forEachEnergySetup([&](uint64_t, uint64_t) {
+			OTPCRunAction::mergeIntoContainer(runConfiguration);
+		});
+		OTPCRunAction::mergeStepTraces(runConfiguration);
+		OTPCRunAction::mergeSummaries(runConfiguration);
+		if (storeResults) {
+			for (auto energy : energies) {
+				runCheckpoint.setEnergyProgress(energy / keV, numberOfEvent);
+			}
+			runCheckpoint.save(0, numberOfEvent, runConfiguration.getRunSeed());
+		}
+#else
+		std::cout << "--fork is only available on Linux" << _endl_;
+		return 1;
+#endif
+	}
+	else {
+		forEachEnergySetup([&](uint64_t energyPointsPerRun, uint64_t setupIndex) {
+			if (storeResults) {
+				// stored events are kept, the run continues after them
+				runSlices(energyPointsPerRun, setupIndex, runCheckpoint.getEnergyProgress(runConfiguration.getEnergyPoint(0).energy / keV), numberOfEvent);
+				return;
+			}
+			// setups finished before the checkpoint are skipped, the interrupted one continues after its last slice
+			if (setupIndex < runCheckpoint.getSetupIndex()) {
+				return;
+			}
+			auto firstEvent = setupIndex == runCheckpoint.getSetupIndex() ? runCheckpoint.getCompletedEvents() : 0;
+			// start a run
+			runSlices(energyPointsPerRun, setupIndex, firstEvent, numberOfEvent);
+		});
 	}
 	auto stop = std::chrono::high_resolution_clock::now();
 	std::cout << double((stop - start).count()) / 1e9 << '\n';
@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////
+//
+//  Reduces the events of a run directory to gamma spectra:
+//  per-crystal, sum and addback spectrum of every energy with
+//  the detector resolution folded in, written next to the
+//  container as spectra_<energy>keV.tsv. Runs written with a
+//  trigger keep only the accepted events, prescaled samples of
+//  rejected events are skipped
+//
+////////////////////////////////////////////////////////////////
+
+#include "OTPCEventReader.hh"
+#include "OTPCSpectrum.hh"
+
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <filesystem>
+#include <format>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <bit>
+
+namespace po = boost::program_options;
+
+int main(int argc, char** argv) {
+	std::string
+		runDirectoryArg,
+		scintillatorType,
+		resolutionArg;
+	double
+		threshold = 10,
+		binWidth = 1,
+		maximalEnergy = 6000;
+	uint64_t
+		seed = 0;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("run", po::value<std::string>(&runDirectoryArg), "run directory with events.otpc")
+		("scintillator", po::value<std::string>(&scintillatorType)->default_value("CeBr3"), "scintillator type, selects the resolution")
+		("resolution", po::value<std::string>(&resolutionArg), "resolution as a,b,c of FWHM^2 = a + b E + c E^2 (in keV), \"0,0,0\" for none")
+		("threshold", po::value<double>(&threshold)->default_value(10), "crystal threshold after folding (in keV)")
+		("bin", po::value<double>(&binWidth)->default_value(1), "bin width (in keV)")
+		("max", po::value<double>(&maximalEnergy)->default_value(6000), "upper edge of the spectra (in keV)")
+		("seed", po::value<uint64_t>(&seed)->default_value(0), "seed of the resolution folding");
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if (vm.count("help") || !vm.count("run")) {
+		std::cout << desc << "\n";
+		return 1;
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::filesystem::path runDirectoryPath = runDirectoryArg;
+	auto resolution = vm.count("resolution") ? OTPCResolution::parse(resolutionArg) : OTPCResolution::forScintillator(scintillatorType);
+
+	OTPCEventReader reader(runDirectoryPath / "events.otpc");
+	for (auto energy : reader.getEnergies()) {
+		OTPCSpectra spectra(binWidth, maximalEnergy, threshold);
+		std::mutex spectraMutex;
+		uint64_t rejectedEvents = 0;
+		reader.forEachBlock(energy, [&](const OTPCEventBlock& block) {
+			// folding of a block depends only on its events, not on the thread that reduces it
+			std::mt19937_64 generator(seed ^ (block.firstEvent * 0x9E3779B97F4A7C15ull) ^ std::bit_cast<uint64_t>(block.energy));
+			auto deposits = block.crystalDeposits();
+			std::vector<double> folded(deposits.size());
+			resolution.smear(deposits, folded, generator);
+
+			// empty without trigger, non-zero decisions are prescaled samples that would bias the spectra
+			auto decisions = block.triggerDecisions();
+			uint64_t blockRejected = 0;
+			OTPCSpectra blockSpectra(binWidth, maximalEnergy, threshold);
+			for (std::size_t index = 0; index < block.size(); index++) {
+				if (!decisions.empty() && decisions[index] != 0) {
+					blockRejected++;
+					continue;
+				}
+				blockSpectra.fillEvent(folded.data() + index * OTPCEventBlock::crystalsPerEvent);
+			}
+			std::lock_guard lock(spectraMutex);
+			spectra.add(blockSpectra);
+			rejectedEvents += blockRejected;
+		});
+		auto spectraPath = runDirectoryPath / std::format("spectra_{}keV.tsv", energy * 1000);
+		spectra.write(spectraPath);
+		std::cout << std::format("{} keV: {} events ({} prescaled rejected skipped) -> {}\n", energy * 1000, spectra.getEventCount(), rejectedEvents, spectraPath.string());
+	}
+	auto stop = std::chrono::high_resolution_clock::now();
+	std::cout << double((stop - start).count()) / 1e9 << '\n';
+	return 0;
+}
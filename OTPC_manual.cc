@@ -43,6 +43,8 @@
 #include "OTPCRunAction.hh"
 #include "OTPCEventAction.hh"
 #include "OTPCSteppingAction.hh"
+#include "OTPCActionInitialization.hh"
+#include "OTPCRunConfiguration.hh"
 
 #include "Randomize.hh"
 #include "globals.hh"
@@ -82,25 +84,15 @@ int main(int argc, char** argv)
 	G4RunManager* runManager = new G4RunManager;
 
 	// set mandatory initialization classes
-	runManager->SetUserInitialization(new OTPCDetectorConstruction);
+	OTPCRunConfiguration runConfiguration(false);
+	runConfiguration.setRunPath(std::filesystem::current_path());
+	auto OTPCdetector = new OTPCDetectorConstruction;
+	OTPCdetector->setRunConfiguration(runConfiguration);
+	runManager->SetUserInitialization(OTPCdetector);
 	runManager->SetUserInitialization(new OTPCPhysicsList("empenelope"));
 
-
-	std::string scint = "CeBr3";
-	// set aditional user action classes
-	OTPCRunAction* OTPCrun = new OTPCRunAction;
-	runManager->SetUserAction(OTPCrun);
-	OTPCEventAction* OTPCevent = new OTPCEventAction(OTPCrun);
-	runManager->SetUserAction(OTPCevent);
-	OTPCSteppingAction* OTPCstep =
-		new OTPCSteppingAction(OTPCevent, scint);
-	runManager->SetUserAction(OTPCstep);
-
-	// set mandatory user action class
-	OTPCPrimaryGeneratorAction*
-		OTPCgun = new OTPCPrimaryGeneratorAction(OTPCrun, false);
-	OTPCgun->setRunPath(std::filesystem::current_path());
-	runManager->SetUserAction(OTPCgun);
+	// set user action classes
+	runManager->SetUserInitialization(new OTPCActionInitialization(runConfiguration));
 
 	//   // set mandatory user action class
 	//   OTPCPrimaryGeneratorAction* OTPCgun =
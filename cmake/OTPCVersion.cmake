@@ -0,0 +1,23 @@
+#----------------------------------------------------------------------------
+# Writes the source revision to OTPCVersion.hh, run at every build
+# (see CMakeLists.txt). The header is only rewritten when the revision
+# changed, so an unchanged tree is not recompiled.
+#
+# -DSOURCE_DIR=<source directory> -DVERSION_HEADER=<generated header>
+#
+execute_process(COMMAND git describe --always --dirty
+  WORKING_DIRECTORY ${SOURCE_DIR}
+  OUTPUT_VARIABLE OTPC_CODE_VERSION
+  OUTPUT_STRIP_TRAILING_WHITESPACE
+  ERROR_QUIET)
+if(NOT OTPC_CODE_VERSION)
+  set(OTPC_CODE_VERSION "unknown")
+endif()
+
+set(versionContent "#define OTPC_CODE_VERSION \"${OTPC_CODE_VERSION}\"\n")
+if(EXISTS ${VERSION_HEADER})
+  file(READ ${VERSION_HEADER} previousContent)
+endif()
+if(NOT "${versionContent}" STREQUAL "${previousContent}")
+  file(WRITE ${VERSION_HEADER} "${versionContent}")
+endif()
@@ -0,0 +1,27 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Creates the user actions, one set per worker thread in MT mode
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCActionInitialization_h
+#define OTPCActionInitialization_h 1
+
+#include "G4VUserActionInitialization.hh"
+
+class OTPCRunConfiguration;
+
+class OTPCActionInitialization : public G4VUserActionInitialization
+{
+public:
+	OTPCActionInitialization(const OTPCRunConfiguration& config);
+	~OTPCActionInitialization() = default;
+
+	void BuildForMaster() const;
+	void Build() const;
+
+private:
+	const OTPCRunConfiguration& runConfiguration;
+};
+
+#endif
@@ -0,0 +1,66 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Append-only binary output written by a background thread.
+// Records are collected in per-file blocks in memory; full blocks are
+// handed to the writer thread and replaced by recycled empty ones, so the
+// event loop waits on I/O only when more than maxQueuedBlocks are pending.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCAsyncWriter_h
+#define OTPCAsyncWriter_h 1
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+class OTPCAsyncWriter
+{
+public:
+	OTPCAsyncWriter(std::size_t blockSizeArg = 1 << 20, std::size_t maxQueuedBlocksArg = 8);
+	~OTPCAsyncWriter();
+
+	// opens a file for appending and returns its handle for write(), all files are opened before the first write
+	std::size_t open(const std::filesystem::path& filePath);
+	void write(std::size_t fileIndex, const void* data, std::size_t size);
+	// writes all buffered records, closes the files and stops the writer thread
+	void close();
+
+private:
+	struct OutputFile {
+		std::filesystem::path filePath;
+		std::ofstream stream;
+		std::vector<char> buffer;
+	};
+	struct Block {
+		OutputFile* file;
+		std::vector<char> data;
+	};
+
+	const std::size_t
+		blockSize,
+		maxQueuedBlocks;
+	std::vector<std::unique_ptr<OutputFile>> files;
+
+	// shared with the writer thread
+	std::mutex mutex;
+	std::condition_variable
+		blockQueued,
+		blockWritten;
+	std::deque<Block> queuedBlocks;
+	std::vector<std::vector<char>> freeBuffers;
+	bool
+		stopWriting = false,
+		writeFailed = false;
+	std::thread writerThread;
+
+	void submit(OutputFile& file);
+	void writeBlocks();
+};
+
+#endif
@@ -0,0 +1,53 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Checkpoint of a run directory written at every event slice boundary.
+// Records the progress, sizes of the output files and the run seed, so an
+// interrupted job can drop partially written data and continue from the
+// last completed slice with the same per-event random streams. Events
+// completed per energy are kept across jobs, see OTPCResultCache.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCCheckpoint_h
+#define OTPCCheckpoint_h 1
+
+#include <filesystem>
+#include <map>
+#include <cstdint>
+
+class OTPCCheckpoint
+{
+public:
+	OTPCCheckpoint(std::filesystem::path runDirectoryPathArg);
+	~OTPCCheckpoint() = default;
+
+	// setupIndex - index of the run configuration (energy), completedEvents - events finished per energy point
+	void save(uint64_t setupIndex, uint64_t completedEvents, uint64_t runSeed);
+	// reads the last checkpoint, returns false if there is none
+	bool load();
+	// truncates output files to the checkpoint, removes newer files
+	void restore();
+
+	uint64_t getSetupIndex() const;
+	uint64_t getCompletedEvents() const;
+	uint64_t getRunSeed() const;
+	// events of the energy (in keV) completed in this run directory, saved with the next checkpoint
+	void setEnergyProgress(double energy, uint64_t completedEventsArg);
+	uint64_t getEnergyProgress(double energy) const;
+
+private:
+	std::filesystem::path
+		runDirectoryPath,
+		checkpointPath;
+
+	uint64_t
+		setupIndex = 0,
+		completedEvents = 0,
+		runSeed = 0;
+	std::map<std::string, uintmax_t> fileSizes;
+	std::map<double, uint64_t> energyProgress;
+
+	static bool isOutputFile(const std::filesystem::path& p);
+};
+
+#endif
@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Compact encoding of event records.
+//
+//  crystals  uint32 mask of crystals with non-zero deposit, followed by
+//            the deposits of these crystals only (4 bytes each)
+//  gas       one 4-byte deposit
+//  primary   energies and position as float32, angles as uint16
+//            fractions of their range (36 bytes instead of 96)
+//
+// Deposits are float32 or, with a fixed-point step, uint32 multiples of
+// the step. Decoding and re-encoding reproduces the encoded bytes exactly.
+// Deposits and the fixed-point step are in keV, as accumulated by the
+// stepping action.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCCompactEncoder_h
+#define OTPCCompactEncoder_h 1
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+class OTPCCompactEncoder
+{
+public:
+	static const std::size_t
+		numberOfCrystals = 20,
+		depositSize = 4,
+		primaryRecordSize = 36;
+
+	// fixedPointStep - deposit precision in keV, 0 for float32
+	OTPCCompactEncoder(double fixedPointStepArg = 0);
+	// from the encoding of a container column, "float32", "fixed:<step>" optionally preceded by "hitmask/"
+	OTPCCompactEncoder(const std::string& description);
+	~OTPCCompactEncoder() = default;
+
+	std::string describe() const;
+
+	void encodeCrystals(const std::array<double, numberOfCrystals>& deposits, std::vector<char>& record) const;
+	std::array<double, numberOfCrystals> decodeCrystals(const char* record, std::size_t size) const;
+
+	void encodeGas(double deposit, char* record) const;
+	double decodeGas(const char* record) const;
+
+	static void encodePrimary(const std::array<double, 12>& primaryInfo, char* record);
+	static std::array<double, 12> decodePrimary(const char* record);
+
+private:
+	double fixedPointStep; // keV
+
+	void encodeDeposit(double deposit, char* out) const;
+	double decodeDeposit(const char* in) const;
+};
+
+#endif
@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Self-describing event container, one per run directory.
+//
+//  header   "OTPCEVT1", version, events per chunk, schema of the columns
+//           (name, element type and count, encoding description)
+//  chunks   zlib-compressed, byte-shuffled blocks of up to eventsPerChunk
+//           events of one column and one energy in increasing event order;
+//           records of variable-length columns are prefixed by their uint16
+//           size. Events filtered out by a trigger leave gaps, the global
+//           event numbers are then stored in the "event" column.
+//  footer   index of the chunks appended since the previous footer (column,
+//           energy, event range, offset, sizes, crc32), offset of the
+//           previous footer (0 for the first one), its own offset and
+//           "OTPCIDX1" as the last 16 bytes
+//
+// The file is append-only: every run appends its chunks and a footer
+// after the previous footer, so every earlier size of the file is still a
+// valid container (used by checkpoint truncation). Footers only index
+// their own chunks and the reader follows the links back to the first
+// one, the index grows with the number of chunks, not with the number
+// of runs.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCContainer_h
+#define OTPCContainer_h 1
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <cstdint>
+
+enum class OTPCColumnType : uint8_t {
+	float64 = 0,
+	float32 = 1,
+	uint8 = 2,
+	uint16 = 3,
+	uint32 = 4,
+	uint64 = 5,
+	variable = 6 // bytes with uint16 size prefix, elementsPerEvent is 0
+};
+
+struct OTPCColumn {
+	std::string name;
+	OTPCColumnType type;
+	uint32_t elementsPerEvent;
+	std::string encoding = ""; // how the records are to be decoded, empty for plain values
+
+	std::size_t elementSize() const;
+	// 0 for variable-length records
+	std::size_t recordSize() const;
+};
+
+struct OTPCChunkEntry {
+	uint32_t column;
+	double energy;       // primary energy of the events (MeV)
+	uint64_t
+		firstEvent,      // global event number of the first event
+		lastEvent,       // and of the last one
+		eventCount,      // equal to lastEvent - firstEvent + 1 unless there are gaps
+		offset,          // of the compressed data in the file
+		compressedSize,
+		rawSize;
+	uint32_t crc;        // of the raw data
+};
+
+class OTPCContainerWriter
+{
+public:
+	// opens an existing container for appending, or creates it with the given schema
+	OTPCContainerWriter(const std::filesystem::path& filePathArg, const std::vector<OTPCColumn>& schemaArg, uint32_t eventsPerChunkArg = 16384);
+	~OTPCContainerWriter();
+
+	uint32_t getEventsPerChunk() const;
+	const std::vector<OTPCColumn>& getSchema() const;
+
+	// compresses and appends one chunk of events, may be called from several threads
+	void appendChunk(uint32_t column, double energy, uint64_t firstEvent, uint64_t lastEvent, uint64_t eventCount, const std::vector<char>& rawData);
+	// writes the footer index, the container is not valid before this is called
+	void close();
+
+private:
+	std::filesystem::path filePath;
+	std::vector<OTPCColumn> schema;
+	uint32_t eventsPerChunk;
+
+	std::mutex fileMutex;
+	std::fstream file;
+	std::vector<OTPCChunkEntry> chunks; // appended by this writer
+	uint64_t previousFooterOffset = 0;
+	bool hasFooter = false;             // opened existing container
+};
+
+// decompresses, unshuffles and verifies one chunk, false if it is corrupted
+bool decodeChunk(const OTPCChunkEntry& chunk, std::size_t elementSize, const char* compressed, std::vector<char>& data);
+
+class OTPCContainerReader
+{
+public:
+	OTPCContainerReader(const std::filesystem::path& filePathArg);
+	~OTPCContainerReader() = default;
+
+	const std::vector<OTPCColumn>& getSchema() const;
+	// index of the column with given name, exit(1) if it is not in the schema
+	uint32_t getColumnIndex(const std::string& name) const;
+	const std::vector<OTPCChunkEntry>& getChunks() const;
+	// distinct energies in the container, in order of first appearance
+	std::vector<double> getEnergies() const;
+	// number of events of a column at an energy
+	uint64_t getEventCount(uint32_t column, double energy) const;
+
+	// decoded records of events [firstEvent, firstEvent + eventCount) of a column at an energy,
+	// events missing in the container are skipped; variable-length records keep their size prefix;
+	// chunks with gaps are resolved with the "event" column
+	std::vector<char> readEvents(uint32_t column, double energy, uint64_t firstEvent, uint64_t eventCount);
+	std::vector<char> readChunk(const OTPCChunkEntry& chunk);
+	// splits data returned by readEvents or readChunk into records (without size prefixes)
+	std::vector<std::string_view> splitRecords(uint32_t column, const std::vector<char>& data) const;
+
+private:
+	std::filesystem::path filePath;
+	std::ifstream file;
+	std::vector<OTPCColumn> schema;
+	uint32_t eventsPerChunk;
+	std::vector<OTPCChunkEntry> chunks;
+
+	// start of every record in the data and its end as the last element
+	std::vector<std::size_t> recordOffsets(uint32_t column, const std::vector<char>& data) const;
+};
+
+#endif
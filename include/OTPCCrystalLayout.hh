@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Arrangement of the gamma detectors around the OTPC by placement copy
+// number, as placed in OTPCDetectorConstruction: two sides, two rows per
+// side, six columns per row with the two central columns missing on the
+// negative side. Crystals next to each other in a row or above each other
+// in a column are neighbours, their deposits are added back together.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCCrystalLayout_h
+#define OTPCCrystalLayout_h 1
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+class OTPCCrystalLayout
+{
+public:
+	static const std::size_t numberOfCrystals = 20;
+
+	struct CrystalPosition {
+		int
+			side,   // -1 or 1
+			row,    // -1 lower, 1 upper
+			column; // 0 to 5
+	};
+
+	// layout of the detector construction
+	static const OTPCCrystalLayout& get();
+
+	const CrystalPosition& getPosition(std::size_t crystal) const;
+	bool areNeighbours(std::size_t a, std::size_t b) const;
+
+	// energies of clusters of neighbouring crystals with deposits above threshold
+	void addback(const double* deposits, double threshold, std::vector<double>& clusters) const;
+
+private:
+	OTPCCrystalLayout();
+
+	std::array<CrystalPosition, numberOfCrystals> positions;
+	// bit b of neighbourMasks[a] is set if crystals a and b are neighbours
+	std::array<uint32_t, numberOfCrystals> neighbourMasks;
+};
+
+#endif
@@ -23,6 +23,7 @@
 #include <iostream>
 #include <filesystem>
 #include <array>
+#include <vector>
 
 #include "G4ThreeVector.hh"
 #include "G4VUserDetectorConstruction.hh"
@@ -31,6 +32,7 @@
 
 class G4VPhysicalVolume;
 class F02ElectricFieldSetup;
+class OTPCRunConfiguration;
 
 class OTPCDetectorConstruction : public G4VUserDetectorConstruction
 {
@@ -39,10 +41,18 @@ public:
 	OTPCDetectorConstruction(G4double crystD, std::string scintT);
 	~OTPCDetectorConstruction() = default;
 	G4VPhysicalVolume* Construct();
+	// scoring of the crystals and the gas, per thread
+	void ConstructSDandField();
+	// needed by the scoring, set before the run manager is initialized
+	void setRunConfiguration(const OTPCRunConfiguration& config);
 	const G4double getCrystalDepth();
 	const std::string& getScintillatorType();
 	void saveDetails(std::filesystem::path p);
 	G4ThreeVector getChamberCorner();
+	// half lengths of the gas volume, placed at the origin
+	G4ThreeVector getActiveVolumeHalfSize();
+	// gas composition and conditions read by Construct
+	static std::filesystem::path getGeometryFilePath();
 private:
 	F02ElectricFieldSetup* fEmFieldSetup;
 	G4String              header1, header2, header3;
@@ -56,6 +66,10 @@ private:
 	std::string scintillatorType = "CeBr3";
 	std::string realScintillatorType = "error";
 	G4ThreeVector chamberCorner;
+	G4ThreeVector activeVolumeHalfSize;
+	// crystal index by copy number of the gamma detector placement
+	std::vector<G4int> crystalIndices;
+	const OTPCRunConfiguration* runConfiguration = nullptr;
 };
 
 #endif
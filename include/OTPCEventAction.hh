@@ -22,7 +22,7 @@
 #include "globals.hh"
 #include <array>
 #include <vector>
-#include <tuple>
+#include "OTPCStepTrace.hh"
 
 class G4Event;
 class OTPCRunAction;
@@ -36,26 +36,31 @@ public:
 public:
 	void BeginOfEventAction(const G4Event*);
 	void EndOfEventAction(const G4Event*);
-	void addEdep(G4double Edep, G4double x, G4double y, G4double z);
-	void addProcess(G4double x, G4double y, G4double z, G4String name);
+	// process and particle as IDs of OTPCNameTable
+	void addProcess(G4double x, G4double y, G4double z, uint16_t process, uint16_t particle);
 	void depositEnergyOnCrystal(G4int nCrystal, G4double edep);
 	void depositEnergyOnGas(G4double edep);
+	void depositEnergyOnVoxel(uint32_t voxel, G4double edep);
 	void setFlag();
+	void setDecay();
 
 private:
 	OTPCRunAction* runAction;
 	G4int Range;
 
-	std::vector<std::tuple<G4double, G4double, G4double, G4String>>
+	// per-event buffers are cleared at the beginning of every event and keep their memory,
+	// once they reached the size of the largest events no event allocates
+	std::vector<OTPCStep>
 		ProcessStep;
-	std::vector<std::array<G4double, 4>>
-		EnergyDeposit;
+	std::vector<std::pair<uint32_t, G4double>>
+		VoxelDeposits;
 	std::array<G4double, 20>
 		TotalEnergyDepositCrystal = { 0 };
 	G4double
 		TotalEnergyDepositGas;
 	const bool includeZeroEnergy = true;
 	bool internalFlag;
+	bool decayFlag;
 };
 
 #endif
@@ -0,0 +1,141 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Memory-mapped reader of run containers for analysis.
+//
+// Events are read in blocks, the chunks of all columns of one energy that
+// hold the same events. A block decodes each chunk once; the full-precision
+// columns are then exposed without further copies as contiguous spans
+// (crystal deposits 20 per event, primary info 12 per event), compact
+// columns are expanded to the same layout. Blocks are independent, so they
+// can be decoded and processed concurrently with forEachBlock.
+// Deposits are in keV, primary info as described in OTPCCompactEncoder.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCEventReader_h
+#define OTPCEventReader_h 1
+
+#include "OTPCContainer.hh"
+#include "OTPCCompactEncoder.hh"
+
+#include <filesystem>
+#include <vector>
+#include <span>
+#include <map>
+#include <array>
+#include <numeric>
+#include <optional>
+#include <algorithm>
+#include <execution>
+#include <cstdint>
+
+// read-only mapping of a whole file
+class OTPCMappedFile
+{
+public:
+	OTPCMappedFile(const std::filesystem::path& filePath);
+	~OTPCMappedFile();
+	OTPCMappedFile(const OTPCMappedFile&) = delete;
+	OTPCMappedFile& operator=(const OTPCMappedFile&) = delete;
+
+	const char* data() const;
+	std::size_t size() const;
+
+private:
+	const char* mapping = nullptr;
+	std::size_t mappingSize = 0;
+	std::vector<char> contents; // without mmap the file is read into memory
+};
+
+class OTPCEventBlock
+{
+public:
+	static const std::size_t
+		crystalsPerEvent = OTPCCompactEncoder::numberOfCrystals,
+		primaryValuesPerEvent = 12;
+
+	double energy;        // MeV
+	uint64_t
+		firstEvent,
+		lastEvent;
+
+	std::size_t size() const;
+
+	// columns of all events of the block
+	std::span<const double> crystalDeposits() const;
+	std::span<const double> gasDeposits() const;
+	std::span<const double> primaryInfo() const;
+	// empty unless the run had a trigger
+	std::span<const uint8_t> triggerDecisions() const;
+
+	// one event, index within the block
+	std::span<const double, crystalsPerEvent> crystals(std::size_t index) const;
+	double gas(std::size_t index) const;
+	std::span<const double, primaryValuesPerEvent> primary(std::size_t index) const;
+	uint64_t eventNumber(std::size_t index) const;
+
+private:
+	friend class OTPCEventReader;
+
+	std::size_t eventCount = 0;
+	// decoded chunks, or expanded compact records
+	std::vector<char>
+		crystalsData,
+		gasData,
+		primaryData,
+		eventData,
+		triggerData;
+
+	template <typename T>
+	static std::span<const T> view(const std::vector<char>& data) {
+		return { (const T*)data.data(), data.size() / sizeof(T) };
+	}
+};
+
+class OTPCEventReader
+{
+public:
+	OTPCEventReader(const std::filesystem::path& containerPath);
+	~OTPCEventReader() = default;
+
+	std::vector<double> getEnergies() const;
+	uint64_t getEventCount(double energy) const;
+	std::size_t getBlockCount(double energy) const;
+
+	// decodes one block, may be called from several threads
+	OTPCEventBlock readBlock(double energy, std::size_t blockIndex) const;
+
+	// calls function(const OTPCEventBlock&) for all blocks of an energy, concurrently and in no particular order
+	template <typename Function>
+	void forEachBlock(double energy, Function&& function) const {
+		std::vector<std::size_t> blockIndices(getBlockCount(energy));
+		std::iota(blockIndices.begin(), blockIndices.end(), 0);
+		std::for_each(std::execution::par, blockIndices.begin(), blockIndices.end(), [&](std::size_t blockIndex) {
+			function(readBlock(energy, blockIndex));
+		});
+	}
+
+private:
+	enum Column : std::size_t { crystalsColumn, gasColumn, primaryColumn, eventColumn, triggerColumn, numberOfColumns };
+
+	std::filesystem::path filePath;
+	std::vector<OTPCColumn> schema;
+	std::vector<double> energies;
+	// container column of every known column
+	std::array<std::optional<uint32_t>, numberOfColumns> columns;
+	// set for compact columns
+	std::optional<OTPCCompactEncoder>
+		crystalsEncoder,
+		gasEncoder;
+
+	// chunks of every column of a block, ordered by first event within each energy
+	using Block = std::array<const OTPCChunkEntry*, numberOfColumns>;
+	std::vector<OTPCChunkEntry> chunks;
+	std::map<double, std::vector<Block>> blocks;
+
+	OTPCMappedFile file;
+
+	std::vector<char> decode(const OTPCChunkEntry& chunk) const;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Live stream of written events through POSIX shared memory (Linux only).
+//
+// The simulation creates a segment with one single-producer single-
+// consumer ring per worker thread or forked worker process, so producers
+// never contend. Every ring is a power-of-two array of fixed-size records
+// with a head index advanced by the producer and a tail index advanced by
+// the consumer. When a ring is full the producer either waits for an
+// attached consumer (block) or drops the record and counts it (drop);
+// without a consumer records are always dropped, so an unobserved
+// simulation never stalls. Consumers refresh a heartbeat in the segment
+// header on every poll; a consumer that has not polled for 10 s (e.g. it
+// crashed without detaching) no longer blocks the producers.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCEventStream_h
+#define OTPCEventStream_h 1
+
+#include <array>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct OTPCStreamRecord {
+	uint64_t event;                   // global event number
+	double energy;                    // primary energy (MeV)
+	std::array<double, 20> crystals;  // deposits (keV)
+	double gas;                       // deposit (keV)
+	std::array<double, 12> primary;   // as in the "primary" container column
+	uint8_t trigger;                  // failed trigger conditions, 0 without trigger
+};
+
+class OTPCEventStream
+{
+public:
+	enum class Policy { block, drop };
+
+	// creates the segment /name, rings - number of producers, capacity - records per ring (rounded up to a power of two)
+	OTPCEventStream(const std::string& nameArg, std::size_t rings, std::size_t capacity, Policy policyArg);
+	~OTPCEventStream();
+	OTPCEventStream(const OTPCEventStream&) = delete;
+	OTPCEventStream& operator=(const OTPCEventStream&) = delete;
+
+	static Policy parsePolicy(const std::string& policy);
+	std::size_t getNumberOfRings() const;
+
+	// called by the producer of the ring only, false if the record was dropped
+	bool publish(std::size_t ring, const OTPCStreamRecord& record);
+	// the consumer finishes once all rings are drained
+	void close();
+
+private:
+	std::string name;
+	Policy policy;
+	void* segment = nullptr;
+	std::size_t segmentSize = 0;
+};
+
+class OTPCStreamConsumer
+{
+public:
+	// attaches to the segment of a running simulation
+	OTPCStreamConsumer(const std::string& nameArg);
+	~OTPCStreamConsumer();
+	OTPCStreamConsumer(const OTPCStreamConsumer&) = delete;
+	OTPCStreamConsumer& operator=(const OTPCStreamConsumer&) = delete;
+
+	// appends up to maxRecords available records of all rings, returns their number;
+	// to keep block policy in effect it has to be called at least every 10 s
+	std::size_t poll(std::vector<OTPCStreamRecord>& records, std::size_t maxRecords = SIZE_MAX);
+	// the simulation closed the stream and everything was consumed
+	bool isFinished() const;
+	// records dropped by the producers so far
+	uint64_t getDroppedRecords() const;
+
+private:
+	std::string name;
+	void* segment = nullptr;
+	std::size_t segmentSize = 0;
+};
+
+#endif
@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Long-lived simulation server, keeps the Geant4 kernel initialized and
+// runs jobs received over a local UNIX socket one after another (Linux only).
+//
+// One job per line, whitespace separated key=value pairs:
+//   energy=<keV> events=<N> output=<directory> [position=<x>,<y>,<z> (mm)] [first_event=<N>]
+// Random streams are keyed by (run seed, energy, event number), so jobs of
+// one energy continue the event numbering of the previous ones unless
+// first_event is given; the seed and the events of every job are appended
+// to jobs.txt of its output directory.
+// "shutdown" stops the server after the running job.
+// Status lines sent back to the client:
+//   queued <id> | started <id> | done <id> <events> <seconds> | failed <id> <reason> | error <reason>
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCJobServer_h
+#define OTPCJobServer_h 1
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+#include <filesystem>
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+class G4RunManager;
+class OTPCRunConfiguration;
+
+class OTPCJobServer
+{
+public:
+	OTPCJobServer(G4RunManager* runManagerArg, OTPCRunConfiguration& config, std::filesystem::path socketPathArg);
+	~OTPCJobServer();
+
+	// serves jobs until shutdown is requested by a client
+	int run();
+
+private:
+	struct ClientConnection {
+		int socket;
+		std::mutex sendMutex;
+		ClientConnection(int socketArg) : socket(socketArg) {}
+		~ClientConnection();
+		void send(const std::string& message);
+	};
+
+	struct Job {
+		uint64_t id;
+		G4double energy;
+		G4ThreeVector position;
+		uint64_t events;
+		uint64_t firstEvent; // UINT64_MAX - after the previous job of the energy
+		std::filesystem::path outputPath;
+		std::shared_ptr<ClientConnection> client;
+	};
+
+	void acceptConnections();
+	void readJobs(std::shared_ptr<ClientConnection> client);
+	bool parseJob(const std::string& line, Job& job, std::string& error);
+	void runJob(const Job& job);
+
+	G4RunManager* runManager;
+	OTPCRunConfiguration& runConfiguration;
+	std::filesystem::path socketPath;
+	int serverSocket = -1;
+
+	std::deque<Job> jobQueue;
+	std::mutex queueMutex;
+	std::condition_variable queueCondition;
+	bool stopRequested = false;
+	uint64_t jobCounter = 0;
+	std::map<G4double, uint64_t> nextEvents; // first unused event number by energy, used by the job thread only
+
+	struct Reader {
+		std::thread thread;
+		std::shared_ptr<std::atomic<bool>> finished; // set when the client disconnected
+		std::weak_ptr<ClientConnection> client;
+	};
+
+	std::thread listener;
+	std::vector<Reader> readers;
+};
+
+#endif
@@ -0,0 +1,52 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Counter-based Philox4x32-10 random engine (Salmon et al., SC'11).
+// The output is a pure function of (key, counter), so every event gets its
+// own stream selected by the run seed, the energy and the event number and
+// can be regenerated on its own, independently of thread or process.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCPhiloxEngine_h
+#define OTPCPhiloxEngine_h 1
+
+#include "globals.hh"
+#include "CLHEP/Random/RandomEngine.h"
+#include <array>
+#include <cstdint>
+
+class OTPCPhiloxEngine : public CLHEP::HepRandomEngine
+{
+public:
+	OTPCPhiloxEngine(uint64_t seed = 0);
+	~OTPCPhiloxEngine() = default;
+
+	// selects the stream of one event and rewinds it
+	void setStream(uint64_t runSeed, G4double energy, uint64_t eventNumber);
+	// run seed of a job started without --seed, from std::random_device, the clock and the process id
+	static uint64_t makeRunSeed();
+
+	double flat() override;
+	void flatArray(const int size, double* vect) override;
+	void setSeed(long seed, int) override;
+	void setSeeds(const long* seeds, int) override;
+	void saveStatus(const char filename[] = "Philox.conf") const override;
+	void restoreStatus(const char filename[] = "Philox.conf") override;
+	void showStatus() const override;
+	std::string name() const override;
+	std::ostream& put(std::ostream& os) const override;
+	std::istream& get(std::istream& is) override;
+
+private:
+	using Block = std::array<uint32_t, 4>;
+
+	std::array<uint32_t, 2> key;
+	Block counter;
+	Block output;
+	int outputIndex; // next unused 64-bit half of the output block
+
+	static Block philox(Block ctr, std::array<uint32_t, 2> k);
+	void setKey(uint64_t k);
+};
+
+#endif
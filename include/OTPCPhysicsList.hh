@@ -59,6 +59,9 @@ public:
 	void AddDecay();
 	void AddRadioactiveDecay();
 	void AddStepMax();
+	// local deposition of electrons by their CSDA range, see OTPCRangeCut; set before the run manager is initialized
+	void setRangeCut(G4bool enabled, G4double tolerance);
+	void AddRangeCut();
 
 	void AddIonGasModels();
 
@@ -72,6 +75,8 @@ private:
 	std::unique_ptr<OTPCPhysicsListMessenger> fMessenger;
 
 	G4String physicsListName = "emlivermore";
+	G4bool rangeCut = false;
+	G4double rangeCutTolerance = 0;
 	//G4String name = "local";
 	//G4String name="emstandard_opt3";
 	//G4String name="empenelope";
@@ -15,37 +15,38 @@
 #include <array>
 #include <filesystem>
 #include <fstream>
+#include <string>
 
 class G4Event;
 class OTPCRunAction;
+class OTPCRunConfiguration;
+class OTPCPhiloxEngine;
 
 extern std::ifstream eventInputFile;
 
 class OTPCPrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 {
 public:
-	OTPCPrimaryGeneratorAction(OTPCRunAction*, bool loadDataFromFileArg);
+	OTPCPrimaryGeneratorAction(OTPCRunAction*, const OTPCRunConfiguration& config);
 	~OTPCPrimaryGeneratorAction() = default;
 
 public:
 	void GeneratePrimaries(G4Event* anEvent);
-	void setRunPath(std::filesystem::path runPath);
 	G4ParticleGun* GetParticleGun() { return particleGun.get(); };
-	G4double getEnergy(int index = 0) const;
-	void setEnergy(G4double energy, int index = 0);
-	void setPosition(G4ThreeVector pos);
+	const std::array<G4double, 12>& getPrimaryInfo() const;
+	// names and units of the primary info fields
+	static const std::array<std::string, 12> primaryInfoNames;
 private:
 	OTPCRunAction* runAction;
+	const OTPCRunConfiguration& runConfiguration;
 	std::unique_ptr<G4ParticleGun> particleGun;
+	OTPCPhiloxEngine* randomEngine;
 
-	std::fstream metaFile;
 	std::array<G4double, 3> E, theta, phi;
-	std::array<G4int, 3> type = { 4, 0, 0 };
-	G4ThreeVector position = { 0 * mm, 0 * mm, 0 * mm };
+	std::array<G4double, 12> primaryInfo;
+	G4ThreeVector position;
 	std::array<G4ParticleDefinition*, 5> particleDefinitions;
 	const bool loadDataFromFile;
-
-	void loadData();
 };
 
 #endif
@@ -0,0 +1,46 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Local deposition of electrons that cannot leave their volume.
+//
+// An electron whose CSDA range in the current material is shorter than
+// its distance to the nearest volume boundary (the safety), or than the
+// tolerance, deposits its kinetic energy at once in a step of zero length
+// and is killed. The deposit is scored like any other step of the volume
+// (see OTPCSensitiveDetector), the low-energy tail of steps down to the
+// tracking cut is skipped. The CSDA range is an upper limit of the path,
+// so with tolerance 0 no energy changes volume; a tolerance moves deposits
+// by at most its length. Secondaries of the skipped steps (bremsstrahlung,
+// fluorescence) are not produced.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCRangeCut_h
+#define OTPCRangeCut_h 1
+
+#include "globals.hh"
+#include "G4VDiscreteProcess.hh"
+
+class G4LossTableManager;
+
+class OTPCRangeCut : public G4VDiscreteProcess
+{
+public:
+	// tolerance - range below which electrons are always deposited
+	OTPCRangeCut(G4double toleranceArg, const G4String& processName = "RangeCut");
+	~OTPCRangeCut() = default;
+
+	G4bool IsApplicable(const G4ParticleDefinition& particle) override;
+
+	G4double PostStepGetPhysicalInteractionLength(const G4Track& track, G4double previousStepSize, G4ForceCondition* condition) override;
+	G4VParticleChange* PostStepDoIt(const G4Track& track, const G4Step&) override;
+
+	G4double GetMeanFreePath(const G4Track&, G4double, G4ForceCondition*) override {
+		return DBL_MAX;
+	};
+
+private:
+	G4double tolerance;
+	G4LossTableManager* lossTableManager;
+};
+
+#endif
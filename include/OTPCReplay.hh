@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Deferred replay of selected events with full step detail.
+//
+// Every event draws from its own random stream keyed by (run seed, energy,
+// global event number), see OTPCPhiloxEngine, so the production pass only
+// records the run seed in replay.txt of the run directory; the trigger
+// decision of the written events is in the "trigger" column of the run
+// container. A replay simulates the selected events again with step
+// capture enabled, into the "replay" subdirectory of the run. Geometry,
+// physics and source options have to be the same as in production.
+//
+// Selection file: one "energy eventNumber" per line, energy in MeV as
+// stored in the container (shortest exact decimal form).
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCReplay_h
+#define OTPCReplay_h 1
+
+#include <filesystem>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+class OTPCReplay
+{
+public:
+	OTPCReplay(std::filesystem::path runDirectoryPathArg);
+	~OTPCReplay() = default;
+
+	// production pass
+	void saveRunSeed(uint64_t runSeed) const;
+
+	// replay
+	bool hasRunSeed() const;
+	uint64_t loadRunSeed() const;
+	void loadSelection(const std::filesystem::path& selectionPath);
+	// all events the trigger accepted, prescaled samples of rejected events are left out
+	void selectAccepted();
+	// selected global event numbers of every energy (MeV), in increasing order
+	const std::map<double, std::vector<uint64_t>>& getSelection() const;
+	std::filesystem::path getReplayPath() const;
+
+private:
+	std::filesystem::path
+		runDirectoryPath,
+		seedPath;
+	std::map<double, std::vector<uint64_t>> selection;
+
+	void sortSelection();
+};
+
+#endif
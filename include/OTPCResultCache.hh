@@ -0,0 +1,65 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Content-addressed store of simulation results.
+//
+// Every input that changes the simulated events or the written output
+// (geometry and particle files, materials, physics list, cuts, source,
+// output options and the code version) is collected into a text
+// description. Its hash names the run directory of the configuration in
+// the store, so equal configurations share results whatever the run
+// directory name would have been, and different ones never do.
+//
+// The number of events and the seed are not part of the key: events of
+// an energy are completed slice by slice (see OTPCCheckpoint), a job
+// asking for more events than stored simulates only the missing ones
+// with the seed of the stored run, the per-event random streams make
+// them continue the stored events.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCResultCache_h
+#define OTPCResultCache_h 1
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <utility>
+
+// source revision, generated at every CMake build (cmake/OTPCVersion.cmake)
+#if __has_include("OTPCVersion.hh")
+#include "OTPCVersion.hh"
+#endif
+#ifndef OTPC_CODE_VERSION
+#define OTPC_CODE_VERSION "unknown"
+#endif
+
+class OTPCResultCache
+{
+public:
+	OTPCResultCache(std::filesystem::path storePathArg);
+	~OTPCResultCache();
+	OTPCResultCache(const OTPCResultCache&) = delete;
+	OTPCResultCache& operator=(const OTPCResultCache&) = delete;
+
+	// inputs of the configuration, in the order they are added
+	void add(const std::string& key, const std::string& value);
+	// content of an input file, a missing file is recorded as such
+	void addFile(const std::string& key, const std::filesystem::path& filePath);
+	// every material of the material table with its composition and state
+	void addMaterials();
+
+	std::string getDescription() const;
+	// 128-bit hash of the description as hex digits
+	std::string getHash() const;
+
+	// run directory of the configuration, created with its description on first use;
+	// locked until the cache is destroyed, so two jobs never simulate into the same directory
+	std::filesystem::path open();
+
+private:
+	std::filesystem::path storePath;
+	std::vector<std::pair<std::string, std::string>> inputs;
+	int lockDescriptor = -1;
+};
+
+#endif
@@ -27,16 +27,28 @@
 #include <vector>
 #include <array>
 #include <filesystem>
+#include <atomic>
 #include "G4Timer.hh"
+#include "G4Accumulable.hh"
+#include "OTPCShardMerger.hh"
+#include "OTPCAsyncWriter.hh"
+#include "OTPCContainer.hh"
+#include "OTPCCompactEncoder.hh"
+#include "OTPCTrigger.hh"
+#include "OTPCStackingRules.hh"
+#include "OTPCStepTrace.hh"
+#include "OTPCRunSummary.hh"
+#include "OTPCVoxel.hh"
 
 class G4Run;
 
 class G4Timer;
+class OTPCRunConfiguration;
 
 class OTPCRunAction : public G4UserRunAction
 {
   public:
-    OTPCRunAction();
+    OTPCRunAction(const OTPCRunConfiguration& config);
     ~OTPCRunAction() = default;
 
   public:
@@ -44,36 +56,97 @@ class OTPCRunAction : public G4UserRunAction
     void EndOfRunAction(const G4Run*);
 
 
-    void fillOut(std::vector<std::array<G4double, 4>>& EnergyDeposit);
-    void fillOutScintillation(std::array<G4double, 20>& EnergyGammaCrystals);
-    void fillOutGasIonization(G4double EnergyGas);
-    void fillOutSteps(std::vector<std::tuple<G4double, G4double, G4double, G4String>>& ProcessSteps, G4double totalEnergy);
+    void fillOutEvent(std::array<G4double, 20>& EnergyGammaCrystals, G4double EnergyGas, bool includeScintillation, G4int eventID);
+    // gas deposits (voxel index, keV) of the last filled out event, written when the event was
+    void fillOutVoxels(std::vector<std::pair<uint32_t, G4double>>& VoxelDeposits);
+    // decay - a radioactive decay happened in the event
+    void fillOutSteps(std::vector<OTPCStep>& ProcessSteps, bool decay, G4double totalEnergy, G4int eventID);
     
     void updateEventCounter(bool flag);
+    // filled by the stacking action of the thread
+    OTPCStackingCounters& getStackingCounters();
+
+    // columns of the run container, crystal deposits, gas deposit and primary particle info per event,
+    // with an enabled trigger also global event number and failed trigger conditions of the written events
+    enum ContainerColumn : uint32_t { crystalsColumn, gasColumn, primaryColumn, eventColumn, triggerColumn };
+    static std::vector<OTPCColumn> getContainerSchema(const OTPCRunConfiguration& config);
+    static std::filesystem::path getContainerPath(const OTPCRunConfiguration& config);
+    // files written by the workers as shards
+    static std::vector<OTPCShardedFile> getShardedFiles(const OTPCRunConfiguration& config);
+    // merges the shards of all workers into the run container
+    static void mergeIntoContainer(const OTPCRunConfiguration& config);
+    // trigger counters appended run by run, see writeTriggerSummary
+    static std::filesystem::path getTriggerSummaryPath(const OTPCRunConfiguration& config);
+    // stacking rule counters appended run by run, see writeStackingSummary
+    static std::filesystem::path getStackingSummaryPath(const OTPCRunConfiguration& config);
+    // steps of selected events, shared by all threads of the process
+    static std::filesystem::path getStepTracePath(const OTPCRunConfiguration& config);
+    // appends the traces of forked workers to the run trace
+    static void mergeStepTraces(const OTPCRunConfiguration& config);
+    // summaries of all runs, see OTPCRunSummary
+    static std::filesystem::path getSummaryPath(const OTPCRunConfiguration& config);
+    // appends the summaries, trigger and stacking counters of forked workers and writes the JSON files
+    static void mergeSummaries(const OTPCRunConfiguration& config);
 
-    void setEventFilePath(std::filesystem::path totalP, std::filesystem::path stepsP);
 private:
-   
+    void fillOutScintillation(std::array<G4double, 20>& EnergyGammaCrystals);
+    void fillOutGasIonization(G4double EnergyGas);
+    void fillOutMetadata(const std::array<G4double, 12>& primaryInfo);
+    // sizePrefix - variable-length record, its size is written in front of it
+    void writeRecord(std::size_t file, const void* data, std::size_t size, bool sizePrefix = false);
+
     std::unique_ptr<G4Timer> timer;
     
     G4RunManager* runManager;
-    G4double currentEnergy;
+    const OTPCRunConfiguration& runConfiguration;
+
+    // per-event records are buffered and written by a background thread, see OTPCAsyncWriter
+    std::unique_ptr<OTPCAsyncWriter> eventWriter;
+
+    // one set of shards per energy point of the run, handles of eventWriter
+    struct EnergyOutput {
+        std::size_t
+            eventTotalDepositFileBinary,
+            eventTotalGasDepositFileBinary,
+            metaFile,
+            eventNumberFile,
+            triggerFile;
+    };
+    std::vector<EnergyOutput> energyOutputs;
 
     std::fstream 
         eventTotalDepositFile,
         eventStepsDepositFile,
-        eventTotalDepositFileBinary,
-        eventTotalGasDepositFileBinary,
         eventStepsDepositFileBinary;
-   
-    uint32_t 
-        eventIndex,
+    // opened by the master before the workers start, events are appended under its lock
+    static std::unique_ptr<OTPCStepTraceWriter> stepTrace;
+
+    // every worker writes its own shards, which the master merges into the container at the end of run
+    std::size_t currentEnergyIndex;
+
+    // optional compact records
+    bool compactEncoding;
+    OTPCCompactEncoder compactEncoder;
+    std::vector<char> compactRecord;
+    uint64_t currentEventKey;
+    bool currentEventWritten;
+    static std::atomic<uint64_t> eventIndex;
+
+    // voxelized gas deposits of the written events, files of every thread in the run directory
+    std::unique_ptr<OTPCVoxelWriter> voxelWriter;
+
+    // per-thread counters, merged into the master at the end of run
+    G4Accumulable<uint32_t>
         eventFlagCounter,
         decayCounter;
-
-    std::filesystem::path 
-        eventTotalDepositFilePath,
-        eventStepsDepositFilePath;
+    OTPCTriggerCounters triggerCounters;
+    OTPCStackingCounters stackingCounters;
+    OTPCRunSummary runSummary;
+
+    // trigger statistics of the run appended to trigger.txt in the run directory
+    void writeTriggerSummary();
+    // tracks and energy of every stacking rule appended to stacking.txt in the run directory
+    void writeStackingSummary();
 };
 
 #endif
@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Run settings shared by the master and all worker threads.
+// Set from main() between runs, read-only while a run is in progress.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCRunConfiguration_h
+#define OTPCRunConfiguration_h 1
+
+#include "G4ThreeVector.hh"
+#include "G4SystemOfUnits.hh"
+#include "globals.hh"
+#include "OTPCTrigger.hh"
+#include "OTPCStackingRules.hh"
+#include "OTPCEventStream.hh"
+#include "OTPCRunSummary.hh"
+#include "OTPCVoxel.hh"
+#include <array>
+#include <vector>
+#include <filesystem>
+
+struct OTPCEnergyPoint {
+	G4double energy;
+	std::filesystem::path
+		eventTotalDepositFilePath,
+		eventStepsDepositFilePath;
+};
+
+class OTPCRunConfiguration
+{
+public:
+	OTPCRunConfiguration(bool loadDataFromFileArg = false);
+	~OTPCRunConfiguration() = default;
+
+	G4double getEnergy(int index = 0) const;
+	void setEnergy(G4double energy, int index = 0);
+	G4int getParticleType(int index) const;
+	const G4ThreeVector& getPosition() const;
+	void setPosition(G4ThreeVector pos);
+	bool isDataLoadedFromFile() const;
+	// particle types and energies read with loadDataFromFile
+	static std::filesystem::path getParticleFilePath();
+
+	void setRunPath(std::filesystem::path runPath);
+	const std::filesystem::path& getRunPath() const;
+	void setEventFilePath(std::filesystem::path totalP, std::filesystem::path stepsP);
+	const std::filesystem::path& getEventTotalDepositFilePath() const;
+	const std::filesystem::path& getEventStepsDepositFilePath() const;
+
+	// energy sweep: events of one run are distributed round-robin over all energy points,
+	// so every point progresses concurrently and gets its own output files
+	void setEnergySweep(std::vector<OTPCEnergyPoint> points);
+	bool isEnergySweep() const;
+	std::size_t getNumberOfEnergyPoints() const;
+	const OTPCEnergyPoint& getEnergyPoint(std::size_t energyIndex) const;
+	std::size_t getEnergyIndex(G4int eventID) const;
+	G4int getEventNumber(G4int eventID) const;
+
+	// numbering of events across slices and forked workers, used to order the merged output
+	void setEventNumbering(uint64_t firstEventNumberArg, uint64_t eventsPerEnergyPointArg);
+	uint64_t getGlobalEventNumber(G4int eventID) const;
+	uint64_t getEventsPerEnergyPoint() const;
+	// replay of selected events: n-th event of the run gets the n-th global event number of the list
+	void setReplayEvents(std::vector<uint64_t> eventNumbers);
+
+	// forked worker processes write shards named by their index, the parent process merges them
+	void setForkedWorker(int64_t workerID);
+	bool isForkedWorker() const;
+	int64_t getShardID() const;
+
+	// compact output records, see OTPCCompactEncoder; fixedPointStep - deposit precision in keV, 0 for float32
+	void setCompactEncoding(bool compact, G4double fixedPointStep = 0);
+	bool isCompactEncoding() const;
+	G4double getFixedPointStep() const;
+
+	// events are written only if accepted by the trigger, when it is enabled
+	void setTrigger(const OTPCTrigger& triggerArg);
+	const OTPCTrigger& getTrigger() const;
+
+	// new tracks are classified by the rules when they are enabled, set before the actions are built
+	void setStackingRules(const OTPCStackingRules& stackingRulesArg);
+	const OTPCStackingRules& getStackingRules() const;
+
+	// seed of the per-event random streams, see OTPCPhiloxEngine
+	void setRunSeed(uint64_t seed);
+	uint64_t getRunSeed() const;
+
+	// written events are also published to this stream when it is set, see OTPCEventStream
+	void setEventStream(OTPCEventStream* stream);
+	OTPCEventStream* getEventStream() const;
+
+	// counters and histograms accumulated during the run, see OTPCRunSummary
+	void setSummarySettings(const OTPCSummarySettings& settings);
+	const OTPCSummarySettings& getSummarySettings() const;
+
+	// gas deposits of written events are exported on this grid when it is enabled, see OTPCVoxel
+	void setVoxelExport(const OTPCVoxelGrid& grid, uint64_t maxFileSize);
+	const OTPCVoxelGrid& getVoxelGrid() const;
+	uint64_t getVoxelFileSize() const;
+
+	// steps of every event are collected and written to the step trace, used when replaying events
+	void setStepCapture(bool capture);
+	bool isStepCapture() const;
+
+private:
+	std::array<G4double, 3> E = { 0, 0, 0 };
+	std::array<G4int, 3> type = { 4, 0, 0 };
+	G4ThreeVector position = { 0 * mm, 0 * mm, 0 * mm };
+	const bool loadDataFromFile;
+
+	std::filesystem::path runDirectoryPath;
+	OTPCEnergyPoint singleEnergyPoint;
+	std::vector<OTPCEnergyPoint> energySweep;
+
+	uint64_t
+		firstEventNumber = 0,
+		eventsPerEnergyPoint = 0;
+	std::vector<uint64_t> replayEvents;
+	int64_t forkedWorkerID = -1;
+	uint64_t runSeed = 0;
+	bool compactEncoding = false;
+	G4double fixedPointStep = 0;
+	OTPCTrigger trigger;
+	OTPCStackingRules stackingRules;
+	bool stepCapture = false;
+	OTPCEventStream* eventStream = nullptr;
+	OTPCSummarySettings summarySettings;
+	OTPCVoxelGrid voxelGrid;
+	uint64_t voxelFileSize = 0;
+
+	void loadData();
+};
+
+#endif
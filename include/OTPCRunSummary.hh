@@ -0,0 +1,115 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Summary statistics accumulated during the run, so that efficiencies
+// and spectra are available without reading the event files.
+//
+// Every thread fills its own counters and fixed-bin histograms of every
+// energy point, the master merges them at the end of run like the other
+// accumulables. Runs append their summaries as records to summary.hist in
+// the run directory (forked workers to shards of it), so the file grows
+// with the slices of a run and is truncated on resume like the event
+// output. All records of an energy are added up and written as
+// summary_<energy>keV.json after every run.
+//
+// A crystal is hit when its deposit exceeds the threshold, the sum of the
+// hit crystals is the event sum. An event is detected when any crystal is
+// hit and in the full-energy peak when the event sum is within the peak
+// window of the primary energy. Hit crystals are also added back over
+// neighbours (see OTPCCrystalLayout), an event is in the addback peak when
+// any of its clusters is. Every ordered pair of hit crystals (a, b) of an
+// event counts in the coincidence matrix at the deposit of a, the matrix
+// is sparse and its size bounded by the binning, not by the number of
+// events. Deposits and energies are in keV.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCRunSummary_h
+#define OTPCRunSummary_h 1
+
+#include "globals.hh"
+#include "G4VAccumulable.hh"
+#include "OTPCSpectrum.hh"
+#include <array>
+#include <vector>
+#include <iosfwd>
+#include <filesystem>
+#include <unordered_map>
+
+struct OTPCSummarySettings {
+	bool enabled = false;
+	double
+		threshold = 10,
+		peakWindow = 1,
+		binWidth = 1,
+		maximum = 6000,
+		gasBinWidth = 0.1,
+		gasMaximum = 200,
+		coincidenceBinWidth = 1; // 0 - no coincidence matrix
+};
+
+class OTPCEnergySummary
+{
+public:
+	static const std::size_t numberOfCrystals = OTPCCrystalLayout::numberOfCrystals;
+
+	OTPCEnergySummary(double energyArg = 0, const OTPCSummarySettings& settings = {});
+	~OTPCEnergySummary() = default;
+
+	void fill(const std::array<G4double, numberOfCrystals>& crystalDeposits, G4double gasDeposit);
+	void add(const OTPCEnergySummary& other);
+	void reset();
+
+	double getEnergy() const;
+	// records of the summary file
+	void write(std::ostream& stream) const;
+	bool read(std::istream& stream);
+	void writeJSON(const std::filesystem::path& jsonPath) const;
+
+private:
+	double
+		energy,
+		threshold,
+		peakWindow;
+	uint64_t
+		events = 0,
+		detectedEvents = 0,
+		peakEvents = 0,
+		addbackPeakEvents = 0,
+		gasEvents = 0;
+	std::array<uint64_t, numberOfCrystals> crystalHits = { 0 };
+	OTPCHistogram
+		sum,
+		addback,
+		gas;
+	std::vector<double> clusters;
+
+	// counts by (a * numberOfCrystals + b) * (coincidenceBins + 1) + deposit bin of a, last bin is the overflow
+	double coincidenceBinWidth;
+	uint32_t coincidenceBins;
+	std::unordered_map<uint32_t, uint64_t> coincidences;
+	void fillCoincidences(const std::array<G4double, numberOfCrystals>& crystalDeposits, uint32_t hitMask);
+};
+
+class OTPCRunSummary : public G4VAccumulable
+{
+public:
+	OTPCRunSummary(const G4String& name);
+	~OTPCRunSummary() = default;
+
+	// energies of the energy points of the run (in keV)
+	void resize(const OTPCSummarySettings& settings, const std::vector<double>& energies);
+	void fill(std::size_t energyIndex, const std::array<G4double, 20>& crystalDeposits, G4double gasDeposit);
+
+	void Merge(const G4VAccumulable& other) override;
+	void Reset() override;
+
+	// appends one record per energy point
+	void append(const std::filesystem::path& summaryPath) const;
+	// adds up the records of every energy and writes its JSON file next to the summary file
+	static void writeJSON(const std::filesystem::path& summaryPath);
+
+private:
+	std::vector<OTPCEnergySummary> energySummaries;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Scoring of the deposits in the crystals and in the gas.
+//
+// The detectors are attached to the crystal and gas logical volumes, so
+// Geant4 calls them only for steps in these volumes and steps in the walls,
+// electrodes and the world run no user code. Deposits count only when the
+// step was limited by one of the accepted processes; the process names are
+// resolved once per thread into the process objects of its physics list,
+// steps are matched by pointer. Deposits go to the event action of the
+// thread in keV. Tracks dropped at their start can have their kinetic
+// energy scored at once in the volume they start in (see
+// OTPCStackingRules).
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCSensitiveDetector_h
+#define OTPCSensitiveDetector_h 1
+
+#include "G4VSensitiveDetector.hh"
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+#include <vector>
+#include <string>
+
+class G4Step;
+class G4Track;
+class G4VProcess;
+class G4HCofThisEvent;
+class G4TouchableHistory;
+class OTPCEventAction;
+class OTPCRunConfiguration;
+
+class OTPCProcessFilter
+{
+public:
+	OTPCProcessFilter(std::vector<std::string> processNamesArg);
+	~OTPCProcessFilter() = default;
+
+	// processes of the calling thread, available once its physics list is built
+	void resolve();
+	bool isResolved() const;
+	bool contains(const G4VProcess* process) const;
+
+private:
+	std::vector<std::string> processNames;
+	std::vector<const G4VProcess*> processes; // sorted
+	bool resolved = false;
+};
+
+class OTPCScoringDetector : public G4VSensitiveDetector
+{
+public:
+	OTPCScoringDetector(const G4String& name);
+	~OTPCScoringDetector() = default;
+
+	// kinetic energy of the track deposited where it starts
+	virtual void depositTrack(const G4Track* track) = 0;
+};
+
+class OTPCCrystalSensitiveDetector : public OTPCScoringDetector
+{
+public:
+	// crystalIndicesArg - crystal index by copy number of the gamma detector placement
+	OTPCCrystalSensitiveDetector(const G4String& name, std::vector<G4int> crystalIndicesArg);
+	~OTPCCrystalSensitiveDetector() = default;
+
+	void Initialize(G4HCofThisEvent*) override;
+	G4bool ProcessHits(G4Step* step, G4TouchableHistory*) override;
+	void depositTrack(const G4Track* track) override;
+
+private:
+	std::vector<G4int> crystalIndices;
+	OTPCProcessFilter processFilter;
+	OTPCEventAction* eventAction = nullptr;
+};
+
+class OTPCGasSensitiveDetector : public OTPCScoringDetector
+{
+public:
+	OTPCGasSensitiveDetector(const G4String& name, const OTPCRunConfiguration& config);
+	~OTPCGasSensitiveDetector() = default;
+
+	void Initialize(G4HCofThisEvent*) override;
+	G4bool ProcessHits(G4Step* step, G4TouchableHistory*) override;
+	void depositTrack(const G4Track* track) override;
+
+private:
+	const OTPCRunConfiguration& runConfiguration;
+	OTPCProcessFilter processFilter;
+	OTPCEventAction* eventAction = nullptr;
+
+	void deposit(G4double edep, const G4ThreeVector& position);
+};
+
+#endif
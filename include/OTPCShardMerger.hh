@@ -0,0 +1,35 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Per-worker output shards and their event-ordered merge.
+// Every shard record is a uint64 event ID followed by the payload, which has
+// the record size of its container column or a uint16 size prefix,
+// the payloads are merged in event ID order into chunks of the run container.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCShardMerger_h
+#define OTPCShardMerger_h 1
+
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+class OTPCContainerWriter;
+
+struct OTPCShardedFile {
+	std::filesystem::path filePath; // common part of the shard names
+	uint32_t column;                // container column of the payloads
+	double energy;                  // energy point of the events
+};
+
+std::filesystem::path shardFilePath(const std::filesystem::path& filePath, int64_t workerID);
+
+std::vector<std::filesystem::path> findShards(const std::filesystem::path& filePath);
+
+// appends shards of one file to the container in event order and removes them, returns number of records
+uint64_t mergeShards(const OTPCShardedFile& shardedFile, OTPCContainerWriter& container);
+
+// merges independent files concurrently
+void mergeShards(const std::vector<OTPCShardedFile>& shardedFiles, OTPCContainerWriter& container);
+
+#endif
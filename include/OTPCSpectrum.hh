@@ -0,0 +1,97 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Energy spectra of the gamma detectors.
+//
+// Deposits are folded with the detector resolution
+//   FWHM(E)^2 = a + b E + c E^2   (E and FWHM in keV)
+// and crystals below the threshold are dropped. The remaining crystals of
+// an event fill the per-crystal spectra, their sum the sum spectrum and
+// every cluster of neighbouring crystals the addback spectrum.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCSpectrum_h
+#define OTPCSpectrum_h 1
+
+#include "OTPCCrystalLayout.hh"
+
+#include <array>
+#include <vector>
+#include <span>
+#include <string>
+#include <random>
+#include <filesystem>
+#include <iosfwd>
+#include <cstdint>
+
+class OTPCHistogram
+{
+public:
+	// bins of binWidth from 0 to maximum, values above are counted as overflow
+	OTPCHistogram(double binWidthArg = 1, double maximum = 0);
+	~OTPCHistogram() = default;
+
+	void fill(double value);
+	void add(const OTPCHistogram& other);
+	// empties all bins, the binning stays
+	void clear();
+
+	double getBinWidth() const;
+	const std::vector<uint64_t>& getCounts() const;
+	uint64_t getOverflow() const;
+
+	// binary form: bin width, number of bins, counts, overflow
+	void write(std::ostream& stream) const;
+	bool read(std::istream& stream);
+
+private:
+	double binWidth;
+	std::vector<uint64_t> counts;
+	uint64_t overflow = 0;
+};
+
+struct OTPCResolution {
+	double a = 0, b = 0, c = 0;
+
+	// typical resolution of the scintillators, about 4 % (CeBr3) and 2.7 % (LaBr3) at 662 keV
+	static OTPCResolution forScintillator(const std::string& scintillator);
+	// "a,b,c"
+	static OTPCResolution parse(const std::string& description);
+
+	double sigma(double energy) const;
+
+	// smeared deposits of crystals, deposits of zero stay zero
+	void smear(std::span<const double> deposits, std::span<double> smeared, std::mt19937_64& generator) const;
+};
+
+class OTPCSpectra
+{
+public:
+	static const std::size_t numberOfCrystals = OTPCCrystalLayout::numberOfCrystals;
+
+	OTPCSpectra(double binWidth, double maximum, double thresholdArg);
+	~OTPCSpectra() = default;
+
+	// deposits of one event after resolution folding
+	void fillEvent(const double* deposits);
+	void add(const OTPCSpectra& other);
+
+	uint64_t getEventCount() const;
+	const OTPCHistogram& getCrystal(std::size_t crystal) const;
+	const OTPCHistogram& getSum() const;
+	const OTPCHistogram& getAddback() const;
+
+	// one line per bin with any counts: lower edge (keV), 20 crystals, sum, addback
+	void write(const std::filesystem::path& spectraPath) const;
+
+private:
+	double threshold;
+	uint64_t eventCount = 0;
+	std::array<OTPCHistogram, numberOfCrystals> crystals;
+	OTPCHistogram
+		sum,
+		addback;
+	std::vector<double> clusters;
+};
+
+#endif
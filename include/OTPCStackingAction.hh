@@ -0,0 +1,49 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Applies the stacking rules (see OTPCStackingRules) to every new track
+// and counts the tracks every rule applied to. Rules of a particle or a
+// volume are looked up by name once per particle definition and volume
+// of the thread, a new track costs two hash lookups and a scan of the
+// rules selecting both.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCStackingAction_h
+#define OTPCStackingAction_h 1
+
+#include "G4UserStackingAction.hh"
+#include "G4ClassificationOfNewTrack.hh"
+#include <unordered_map>
+#include <cstdint>
+
+class G4Track;
+class G4ParticleDefinition;
+class G4LogicalVolume;
+class OTPCStackingRules;
+class OTPCStackingCounters;
+class OTPCScoringDetector;
+
+class OTPCStackingAction : public G4UserStackingAction
+{
+public:
+	OTPCStackingAction(const OTPCStackingRules& rulesArg, OTPCStackingCounters& countersArg);
+	~OTPCStackingAction() = default;
+
+	G4ClassificationOfNewTrack ClassifyNewTrack(const G4Track* track) override;
+
+private:
+	const OTPCStackingRules& rules;
+	OTPCStackingCounters& counters;
+
+	struct VolumeRules {
+		uint64_t mask;
+		OTPCScoringDetector* detector; // for deposited tracks, null in passive volumes
+	};
+	std::unordered_map<const G4ParticleDefinition*, uint64_t> particleRules;
+	std::unordered_map<const G4LogicalVolume*, VolumeRules> volumeRules;
+
+	uint64_t getParticleRules(const G4ParticleDefinition* particle);
+	const VolumeRules& getVolumeRules(const G4LogicalVolume* volume);
+};
+
+#endif
@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Rules of the stacking action deciding what happens to every new track.
+// Read from a text file, one rule per line, the first matching rule
+// applies and tracks matching no rule are tracked as usual:
+//
+//   kill     nu_e,anti_nu_e  *                    # neutrinos leave the setup anyway
+//   deposit  e-              wallsLogical  0 100  # electrons below 100 keV born in the walls
+//   defer    nucleus         *                    # decay products after the prompt particles
+//   track    gamma           *                    # no later rule applies to gammas
+//
+// Particles are particle names or particle types (e.g. nucleus, lepton)
+// separated by commas, the volume is the logical volume the track starts
+// in, * matches any. The optional range of kinetic energy is in keV, the
+// upper limit is excluded.
+//
+//   kill     the track is dropped
+//   deposit  its kinetic energy is scored at once in the crystal or gas it
+//            starts in (lost in passive volumes), then it is dropped
+//   defer    tracked once all other tracks of the event are finished
+//   track    tracked now
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCStackingRules_h
+#define OTPCStackingRules_h 1
+
+#include "globals.hh"
+#include "G4VAccumulable.hh"
+#include <vector>
+#include <array>
+#include <string>
+#include <filesystem>
+#include <limits>
+
+struct OTPCStackingRule {
+	enum Action : uint8_t { kill, deposit, defer, track };
+
+	Action action;
+	std::vector<std::string> particles; // names or types, empty - any
+	std::string volume;                 // empty - any
+	G4double
+		minEnergy = 0,
+		maxEnergy = std::numeric_limits<G4double>::infinity();
+	std::string description;            // rule with defaults filled in, for the summary
+};
+
+class OTPCStackingRules
+{
+public:
+	// rules of a volume or particle are kept as bit mask
+	static constexpr std::size_t maxRules = 64;
+	static const std::array<std::string, 4> actionNames;
+
+	OTPCStackingRules() = default;
+	~OTPCStackingRules() = default;
+
+	void load(const std::filesystem::path& rulesPath);
+	bool isEnabled() const;
+	const std::vector<OTPCStackingRule>& getRules() const;
+
+	// masks of the rules selecting the particle or the volume of origin
+	uint64_t getParticleMask(const std::string& particleName, const std::string& particleType) const;
+	uint64_t getVolumeMask(const std::string& volumeName) const;
+
+private:
+	bool enabled = false;
+	std::vector<OTPCStackingRule> rules;
+};
+
+// tracks and their kinetic energy (keV) by rule, merged from the workers like the other accumulables
+class OTPCStackingCounters : public G4VAccumulable
+{
+public:
+	OTPCStackingCounters(const G4String& name);
+	~OTPCStackingCounters() = default;
+
+	void resize(std::size_t numberOfRules);
+	void count(std::size_t rule, G4double energy);
+	uint64_t getTracks(std::size_t rule) const;
+	G4double getEnergy(std::size_t rule) const;
+
+	void Merge(const G4VAccumulable& other) override;
+	void Reset() override;
+
+private:
+	std::vector<uint64_t> tracks;
+	std::vector<G4double> energies;
+};
+
+#endif
@@ -0,0 +1,130 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Step trace of selected events, one file per run directory.
+//
+//  header   "OTPCSTP1", version
+//  events   step records of one event after another, 16 bytes each:
+//           position (mm) as float32, process and particle IDs as uint16
+//  footer   process and particle names indexed by the IDs, index of the
+//           events (global event number, energy, offset, number of steps),
+//           its offset and "OTPCSIX1" as the last 16 bytes
+//
+// Like the event container the file is append-only, a new footer is
+// written after the previous one when the trace is reopened.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCStepTrace_h
+#define OTPCStepTrace_h 1
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <cstdint>
+
+// process or particle names interned as IDs, shared by all threads of the process
+class OTPCNameTable
+{
+public:
+	static OTPCNameTable& getProcesses();
+	static OTPCNameTable& getParticles();
+
+	uint16_t intern(const std::string& name);
+	// stays valid while names are added
+	const std::string& getName(uint16_t id) const;
+
+private:
+	mutable std::mutex tableMutex;
+	std::deque<std::string> names;
+	std::unordered_map<std::string, uint16_t> ids;
+};
+
+// step as collected during the event, process and particle as IDs of the name tables
+struct OTPCStep {
+	double x, y, z; // mm
+	uint16_t process, particle;
+};
+
+// step as stored in the trace
+struct OTPCStepRecord {
+	float x, y, z;
+	uint16_t process, particle;
+};
+
+struct OTPCTraceEntry {
+	uint64_t event;   // global event number
+	double energy;    // primary energy of the event (MeV)
+	uint64_t offset;  // of the first step record in the file
+	uint32_t stepCount;
+};
+
+class OTPCStepTraceWriter
+{
+public:
+	// the file is created or reopened with the first event, runs without traced events leave no file
+	OTPCStepTraceWriter(const std::filesystem::path& filePathArg);
+	~OTPCStepTraceWriter();
+
+	// appends steps of one event, may be called from several threads
+	void writeEvent(uint64_t eventNumber, double energy, const std::vector<OTPCStep>& steps);
+	// appends all events of another trace (e.g. of a forked worker)
+	void appendTrace(const std::filesystem::path& tracePath);
+	// writes the footer index, the trace is not valid before this is called
+	void close();
+
+private:
+	std::filesystem::path filePath;
+
+	std::mutex fileMutex;
+	std::fstream file;
+	std::vector<std::string>
+		processNames,
+		particleNames;
+	std::unordered_map<std::string, uint16_t>
+		processIDs,
+		particleIDs;
+	// IDs in the file by IDs of the name tables
+	std::vector<uint16_t>
+		processFileIDs,
+		particleFileIDs;
+	std::vector<OTPCTraceEntry> events;
+	std::vector<OTPCStepRecord> records;
+
+	void open();
+	void appendRecords(uint64_t eventNumber, double energy);
+	static uint16_t intern(const std::string& name, std::vector<std::string>& names, std::unordered_map<std::string, uint16_t>& ids);
+	static uint16_t getFileID(uint16_t id, const OTPCNameTable& table, std::vector<uint16_t>& fileIDs, std::vector<std::string>& names, std::unordered_map<std::string, uint16_t>& ids);
+};
+
+class OTPCStepTraceReader
+{
+public:
+	OTPCStepTraceReader(const std::filesystem::path& filePathArg);
+	~OTPCStepTraceReader() = default;
+
+	// traced events in the order they were written
+	const std::vector<OTPCTraceEntry>& getEvents() const;
+	// index of the event in getEvents(), getEvents().size() if it was not traced
+	std::size_t findEvent(uint64_t eventNumber, double energy) const;
+
+	const std::string& getProcessName(uint16_t id) const;
+	const std::string& getParticleName(uint16_t id) const;
+
+	std::vector<OTPCStepRecord> readRecords(const OTPCTraceEntry& entry);
+	// records with the names interned in the name tables
+	std::vector<OTPCStep> readSteps(const OTPCTraceEntry& entry);
+
+private:
+	std::filesystem::path filePath;
+	std::ifstream file;
+	std::vector<std::string>
+		processNames,
+		particleNames;
+	std::vector<OTPCTraceEntry> events;
+};
+
+#endif
@@ -11,7 +11,7 @@
 //////////////////////////////////////////////////////////////////////
 //
 //  V. Guadilla 2021 
-//  Get energy deposited in sensitive volume
+//  Trace the steps of replayed events, only registered when steps are captured
 //
 
 
@@ -19,25 +19,35 @@
 #define OTPCSteppingAction_h 1
 
 #include "G4UserSteppingAction.hh"
-#include <string>
-#include <map>
-#include <array>
-#include <tuple>
+#include <unordered_map>
+#include <cstdint>
 
+class G4VProcess;
+class G4ParticleDefinition;
 class OTPCEventAction;
+class OTPCRunConfiguration;
 
 class OTPCSteppingAction : public G4UserSteppingAction
 {
 public:
-	OTPCSteppingAction(OTPCEventAction*, const std::string& scintName);
-	~OTPCSteppingAction();
+	OTPCSteppingAction(OTPCEventAction*, const OTPCRunConfiguration& config);
+	~OTPCSteppingAction() = default;
 
 	void UserSteppingAction(const G4Step*);
 
 private:
-	std::map<std::string, int> dcs;
-	const std::string& scintilatorType;
 	OTPCEventAction* eventAction;
+	const OTPCRunConfiguration& runConfiguration;
+
+	// IDs of OTPCNameTable by process and particle of this thread, so steps copy no names
+	struct ProcessID {
+		uint16_t id;
+		bool decay;
+	};
+	std::unordered_map<const G4VProcess*, ProcessID> processIDs;
+	std::unordered_map<const G4ParticleDefinition*, uint16_t> particleIDs;
+	const ProcessID& getProcessID(const G4VProcess* process);
+	uint16_t getParticleID(const G4ParticleDefinition* particle);
 };
 
 #endif
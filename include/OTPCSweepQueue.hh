@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Job queue on a shared directory for sweeps over detector configurations.
+//
+// A sweep plan is a text file with one OTPC option per line:
+//   scintillator = CeBr3 LaBr3
+//   depth = 5 10
+//   events = 100000
+// Every combination of the listed values becomes a work unit. Workers on any
+// node claim units through lease directories (mkdir is atomic also on network
+// filesystems), keep the lease alive while the unit runs as a separate OTPC
+// process and mark it done. Leases not refreshed for leaseDuration are
+// taken over by other workers: leases of a unit are numbered (unit.N) and
+// the worker creating the next number claims it, so a lease is never
+// taken over twice.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCSweepQueue_h
+#define OTPCSweepQueue_h 1
+
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+class OTPCSweepQueue
+{
+public:
+	OTPCSweepQueue(std::filesystem::path queuePathArg, std::chrono::seconds leaseDurationArg);
+	~OTPCSweepQueue() = default;
+
+	// expands the plan into work units appended to the queue, returns number of added units
+	uint64_t enqueuePlan(const std::filesystem::path& planPath, uint64_t baseSeed);
+
+	// claims and runs units until every unit is done or failed, returns number of failed units
+	uint64_t drain(const std::string& executable, const std::string& forwardedArguments);
+
+private:
+	std::filesystem::path
+		queuePath,
+		unitsPath,
+		leasesPath,
+		donePath,
+		failedPath;
+	std::chrono::seconds leaseDuration;
+
+	// leasePath - lease directory of the claim, released when the unit is finished
+	bool tryClaim(const std::string& unitName, std::filesystem::path& leasePath);
+	void release(const std::string& unitName, const std::filesystem::path& leasePath);
+	// generation of a lease directory of the unit, -1 for other entries
+	static int64_t getGeneration(const std::string& unitName, const std::filesystem::path& leasePath);
+	bool isLeaseExpired(const std::filesystem::path& leasePath);
+	int runUnit(const std::string& unitName, const std::filesystem::path& leasePath, const std::string& command);
+};
+
+#endif
@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Online trigger deciding at the end of event whether it is written.
+// Conditions are read from a text file, energies are in keV like the
+// deposits accumulated by the event action:
+//
+//   threshold = 10          # deposit a crystal needs to count as hit
+//   threshold 5 = 50        # threshold of crystal 5 only
+//   multiplicity = 1 2      # accepted range of hit crystals
+//   gas = 0 100             # accepted range of gas deposit
+//   sum = 500 2000          # accepted range of deposit summed over crystals
+//   prescale = 1000         # every 1000th rejected event is written anyway
+//
+// Omitted conditions always pass.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCTrigger_h
+#define OTPCTrigger_h 1
+
+#include "globals.hh"
+#include "G4VAccumulable.hh"
+#include <vector>
+#include <array>
+#include <string>
+#include <filesystem>
+#include <limits>
+
+class OTPCTrigger
+{
+public:
+	// bits of the conditions an event failed
+	enum Condition : uint8_t {
+		multiplicityCondition = 1,
+		gasCondition = 2,
+		sumCondition = 4
+	};
+	static const std::size_t numberOfConditions = 3;
+	static const std::array<std::string, numberOfConditions> conditionNames;
+
+	OTPCTrigger() = default;
+	~OTPCTrigger() = default;
+
+	void load(const std::filesystem::path& triggerPath);
+	bool isEnabled() const;
+
+	// mask of failed conditions, 0 if the event is accepted
+	uint8_t evaluate(const std::array<G4double, 20>& crystalDeposits, G4double gasDeposit) const;
+	// rejected events with this global event number are written as a sample for efficiency checks
+	bool isPrescaled(uint64_t eventNumber) const;
+
+private:
+	bool enabled = false;
+	std::array<G4double, 20> thresholds = { 0 };
+	G4int
+		minMultiplicity = 0,
+		maxMultiplicity = 20;
+	G4double
+		minGas = 0,
+		maxGas = std::numeric_limits<G4double>::max(),
+		minSum = 0,
+		maxSum = std::numeric_limits<G4double>::max();
+	uint64_t prescale = 0; // 0 - rejected events are only counted
+};
+
+// trigger statistics of every energy point, merged from the workers like the other accumulables
+class OTPCTriggerCounters : public G4VAccumulable
+{
+public:
+	enum Counter : std::size_t {
+		processedCounter,
+		acceptedCounter,
+		prescaledCounter,      // rejected, but written as a sample
+		firstConditionCounter  // failures of every condition follow
+	};
+	static const std::size_t countersPerEnergy = firstConditionCounter + OTPCTrigger::numberOfConditions;
+
+	OTPCTriggerCounters(const G4String& name);
+	~OTPCTriggerCounters() = default;
+
+	void resize(std::size_t numberOfEnergyPoints);
+	void count(std::size_t energyIndex, std::size_t counter);
+	uint64_t get(std::size_t energyIndex, std::size_t counter) const;
+
+	void Merge(const G4VAccumulable& other) override;
+	void Reset() override;
+
+private:
+	std::vector<uint64_t> counts;
+};
+
+#endif
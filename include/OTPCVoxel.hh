@@ -0,0 +1,137 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Gas deposits on a fixed voxel grid over the active volume, written as
+// training data for track classification.
+//
+// Every thread writes its own files <prefix>_<part>.vox for its whole
+// lifetime, a new part is started when a file exceeds its size limit:
+//
+//  header   "OTPCVOX1", version, grid shape (x, y, z), lower and upper
+//           grid corner (mm), deposit step (keV per count), label names
+//  blocks   "VBLK", number of events, raw and compressed size, crc32 of
+//           the raw data, zlib-compressed events:
+//             event number (uint64), energy (MeV, double), labels (float),
+//             number of voxels n (uint32), n voxel indices (uint32, the
+//             first one absolute, then differences), n deposits (uint16)
+//
+// Voxel index is (x * shape[1] + y) * shape[2] + z, voxels are in
+// increasing index order. Deposits are rounded to the step and saturate at
+// 65535 steps, voxels rounded to zero are left out. A file of an
+// interrupted job ends with complete blocks after checkpoint truncation,
+// the reader ignores an incomplete last block anyway.
+//
+/////////////////////////////////////////////////////////////////////////
+
+#ifndef OTPCVoxel_h
+#define OTPCVoxel_h 1
+
+#include <array>
+#include <vector>
+#include <string>
+#include <span>
+#include <utility>
+#include <fstream>
+#include <filesystem>
+#include <cstdint>
+
+class OTPCVoxelGrid
+{
+public:
+	OTPCVoxelGrid() = default;
+	// lower, upper - corners of the grid (mm), step - deposit quantization (keV)
+	OTPCVoxelGrid(std::array<uint32_t, 3> shapeArg, std::array<double, 3> lowerArg, std::array<double, 3> upperArg, double stepArg);
+	~OTPCVoxelGrid() = default;
+
+	// "nx,ny,nz"
+	static std::array<uint32_t, 3> parseShape(const std::string& description);
+
+	bool isEnabled() const;
+	const std::array<uint32_t, 3>& getShape() const;
+	const std::array<double, 3>& getLower() const;
+	const std::array<double, 3>& getUpper() const;
+	double getStep() const;
+	uint64_t getNumberOfVoxels() const;
+
+	// index of the voxel containing the point (mm), -1 outside of the grid
+	int64_t getIndex(double x, double y, double z) const;
+
+private:
+	std::array<uint32_t, 3> shape = { 0, 0, 0 };
+	std::array<double, 3>
+		lower = { 0, 0, 0 },
+		upper = { 0, 0, 0 },
+		inverseVoxelSize = { 0, 0, 0 };
+	double step = 0;
+};
+
+class OTPCVoxelWriter
+{
+public:
+	OTPCVoxelWriter(std::filesystem::path filePrefixArg, const OTPCVoxelGrid& gridArg, std::vector<std::string> labelNamesArg,
+		uint64_t maxFileSizeArg, uint32_t eventsPerBlockArg = 1024);
+	~OTPCVoxelWriter();
+	OTPCVoxelWriter(const OTPCVoxelWriter&) = delete;
+	OTPCVoxelWriter& operator=(const OTPCVoxelWriter&) = delete;
+
+	// deposits (voxel index, keV) in any order, deposits of one voxel are summed; reordered by the call
+	void writeEvent(uint64_t eventNumber, double energy, std::span<const double> labels, std::vector<std::pair<uint32_t, double>>& deposits);
+	const std::filesystem::path& getFilePrefix() const;
+	// writes the pending block and keeps the part open, its size is then final up to here
+	void flush();
+	void close();
+
+private:
+	std::filesystem::path filePrefix;
+	OTPCVoxelGrid grid;
+	std::vector<std::string> labelNames;
+	uint64_t maxFileSize;
+	uint32_t eventsPerBlock;
+
+	std::ofstream file;
+	uint64_t fileSize = 0;
+	std::vector<char> block;
+	uint32_t blockEvents = 0;
+	std::vector<uint32_t> indices;
+	std::vector<uint16_t> values;
+
+	void openPart();
+	void flushBlock();
+};
+
+struct OTPCVoxelEvent {
+	uint64_t eventNumber;
+	double energy;
+	std::vector<float> labels;
+	std::vector<uint32_t> indices; // absolute, increasing
+	std::vector<uint16_t> values;  // deposits in steps
+
+	// dense tensor of deposits (keV) in voxel index order
+	void toDense(const OTPCVoxelGrid& grid, std::vector<float>& tensor) const;
+};
+
+class OTPCVoxelReader
+{
+public:
+	OTPCVoxelReader(const std::filesystem::path& filePathArg);
+	~OTPCVoxelReader() = default;
+
+	const OTPCVoxelGrid& getGrid() const;
+	const std::vector<std::string>& getLabelNames() const;
+
+	// next event of the file, false at its end
+	bool next(OTPCVoxelEvent& event);
+
+private:
+	std::filesystem::path filePath;
+	std::ifstream file;
+	OTPCVoxelGrid grid;
+	std::vector<std::string> labelNames;
+
+	std::vector<char> block;
+	std::size_t blockPosition = 0;
+	uint32_t blockEvents = 0;
+
+	bool readBlock();
+};
+
+#endif
@@ -0,0 +1,36 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Creates the user actions, one set per worker thread in MT mode
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCActionInitialization.hh"
+#include "OTPCRunConfiguration.hh"
+#include "OTPCPrimaryGeneratorAction.hh"
+#include "OTPCRunAction.hh"
+#include "OTPCEventAction.hh"
+#include "OTPCSteppingAction.hh"
+#include "OTPCStackingAction.hh"
+
+OTPCActionInitialization::OTPCActionInitialization(const OTPCRunConfiguration& config) :
+	runConfiguration(config) {}
+
+void OTPCActionInitialization::BuildForMaster() const {
+	// master only opens/closes output files and merges the counters of the workers
+	SetUserAction(new OTPCRunAction(runConfiguration));
+}
+
+void OTPCActionInitialization::Build() const {
+	OTPCRunAction* OTPCrun = new OTPCRunAction(runConfiguration);
+	SetUserAction(OTPCrun);
+	OTPCEventAction* OTPCevent = new OTPCEventAction(OTPCrun);
+	SetUserAction(OTPCevent);
+	// deposits are scored by the sensitive detectors, steps cost no user code unless they are traced
+	if (runConfiguration.isStepCapture()) {
+		SetUserAction(new OTPCSteppingAction(OTPCevent, runConfiguration));
+	}
+	SetUserAction(new OTPCPrimaryGeneratorAction(OTPCrun, runConfiguration));
+	if (runConfiguration.getStackingRules().isEnabled()) {
+		SetUserAction(new OTPCStackingAction(runConfiguration.getStackingRules(), OTPCrun->getStackingCounters()));
+	}
+}
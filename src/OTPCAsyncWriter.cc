@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Append-only binary output written by a background thread
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCAsyncWriter.hh"
+
+#include <iostream>
+#include <cstring>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCAsyncWriter::OTPCAsyncWriter(std::size_t blockSizeArg, std::size_t maxQueuedBlocksArg) :
+	blockSize(blockSizeArg),
+	maxQueuedBlocks(maxQueuedBlocksArg) {}
+
+OTPCAsyncWriter::~OTPCAsyncWriter() {
+	close();
+}
+
+std::size_t OTPCAsyncWriter::open(const std::filesystem::path& filePath) {
+	auto file = std::make_unique<OutputFile>();
+	file->filePath = filePath;
+	// blocks are written whole, the stream does not need its own buffer
+	file->stream.rdbuf()->pubsetbuf(nullptr, 0);
+	file->stream.open(filePath, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+	if (!file->stream.is_open()) {
+		std::cout << "Cannot open " << filePath << _endl_;
+		exit(1);
+	}
+	file->buffer.reserve(blockSize);
+	files.push_back(std::move(file));
+	if (!writerThread.joinable()) {
+		stopWriting = false;
+		writerThread = std::thread(&OTPCAsyncWriter::writeBlocks, this);
+	}
+	return files.size() - 1;
+}
+
+void OTPCAsyncWriter::write(std::size_t fileIndex, const void* data, std::size_t size) {
+	auto& file = *files[fileIndex];
+	auto bytes = (const char*)data;
+	while (size > 0) {
+		// blocks are filled up to blockSize exactly, so the writes stay block aligned in the file
+		auto chunk = std::min(size, blockSize - file.buffer.size());
+		file.buffer.insert(file.buffer.end(), bytes, bytes + chunk);
+		bytes += chunk;
+		size -= chunk;
+		if (file.buffer.size() == blockSize) {
+			submit(file);
+		}
+	}
+}
+
+void OTPCAsyncWriter::submit(OutputFile& file) {
+	std::unique_lock lock(mutex);
+	blockWritten.wait(lock, [&] { return queuedBlocks.size() < maxQueuedBlocks; });
+	queuedBlocks.push_back({ &file, std::move(file.buffer) });
+	if (!freeBuffers.empty()) {
+		file.buffer = std::move(freeBuffers.back());
+		freeBuffers.pop_back();
+	}
+	else {
+		file.buffer = std::vector<char>();
+		file.buffer.reserve(blockSize);
+	}
+	lock.unlock();
+	blockQueued.notify_one();
+}
+
+void OTPCAsyncWriter::writeBlocks() {
+	std::unique_lock lock(mutex);
+	while (true) {
+		blockQueued.wait(lock, [&] { return stopWriting || !queuedBlocks.empty(); });
+		if (queuedBlocks.empty()) { // stopping and everything is written
+			return;
+		}
+		auto block = std::move(queuedBlocks.front());
+		queuedBlocks.pop_front();
+		lock.unlock();
+
+		block.file->stream.write(block.data.data(), block.data.size());
+		bool failed = !block.file->stream;
+		block.data.clear();
+
+		lock.lock();
+		writeFailed |= failed;
+		freeBuffers.push_back(std::move(block.data));
+		blockWritten.notify_all();
+	}
+}
+
+void OTPCAsyncWriter::close() {
+	if (!writerThread.joinable()) {
+		return;
+	}
+	for (auto& file : files) {
+		if (!file->buffer.empty()) {
+			submit(*file);
+		}
+	}
+	{
+		std::lock_guard lock(mutex);
+		stopWriting = true;
+	}
+	blockQueued.notify_one();
+	writerThread.join();
+
+	for (auto& file : files) {
+		file->stream.close();
+		if (!file->stream) {
+			writeFailed = true;
+		}
+	}
+	if (writeFailed) {
+		std::cout << "Writing of output files failed (disk full?)" << _endl_;
+		exit(1);
+	}
+	files.clear();
+	freeBuffers.clear();
+}
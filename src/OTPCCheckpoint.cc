@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Checkpoint of a run directory written at every event slice boundary
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCCheckpoint.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <format>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCCheckpoint::OTPCCheckpoint(std::filesystem::path runDirectoryPathArg) :
+	runDirectoryPath(runDirectoryPathArg),
+	checkpointPath(runDirectoryPathArg / "checkpoint.txt") {}
+
+bool OTPCCheckpoint::isOutputFile(const std::filesystem::path& p) {
+	// counters appended run by run count as output, lines of an abandoned slice are cut off with it
+	return p.extension() == ".bin" || p.extension() == ".otpc" || p.extension() == ".trace" || p.extension() == ".hist" || p.extension() == ".vox" ||
+		p.filename() == "trigger.txt" || p.filename() == "stacking.txt" || p.filename().string().find(".shard") != std::string::npos;
+}
+
+void OTPCCheckpoint::save(uint64_t setupIndexArg, uint64_t completedEventsArg, uint64_t runSeedArg) {
+	setupIndex = setupIndexArg;
+	completedEvents = completedEventsArg;
+	runSeed = runSeedArg;
+
+	// output files are closed (and merged) at the end of every run, their sizes are final
+	fileSizes.clear();
+	for (const auto& entry : std::filesystem::directory_iterator(runDirectoryPath)) {
+		if (entry.is_regular_file() && isOutputFile(entry.path())) {
+			fileSizes[entry.path().filename().string()] = entry.file_size();
+		}
+	}
+	// written aside and renamed, so a job killed while saving keeps the previous checkpoint
+	auto temporaryPath = checkpointPath;
+	temporaryPath += ".tmp";
+	{
+		std::ofstream checkpointFile(temporaryPath, std::ios_base::out | std::ios_base::trunc);
+		checkpointFile << std::format("setup {}\nevents {}\nseed {}\n", setupIndex, completedEvents, runSeed);
+		for (const auto& [energy, energyEvents] : energyProgress) {
+			checkpointFile << std::format("energy {} {}\n", energy, energyEvents);
+		}
+		for (const auto& [fileName, size] : fileSizes) {
+			checkpointFile << std::format("file {} {}\n", size, fileName);
+		}
+		checkpointFile.flush();
+		if (!checkpointFile) {
+			// a run continuing without its checkpoint could not be resumed correctly
+			std::cout << "Cannot write checkpoint " << temporaryPath << _endl_;
+			exit(1);
+		}
+	}
+	std::filesystem::rename(temporaryPath, checkpointPath);
+}
+
+bool OTPCCheckpoint::load() {
+	std::ifstream checkpointFile(checkpointPath);
+	if (!checkpointFile.is_open()) {
+		return false;
+	}
+	fileSizes.clear();
+	energyProgress.clear();
+	std::string line;
+	while (std::getline(checkpointFile, line)) {
+		std::istringstream lineStream(line);
+		std::string key;
+		lineStream >> key;
+		if (key == "setup") {
+			lineStream >> setupIndex;
+		}
+		else if (key == "events") {
+			lineStream >> completedEvents;
+		}
+		else if (key == "file") {
+			uintmax_t size;
+			lineStream >> size;
+			lineStream.ignore(1);
+			std::string fileName;
+			std::getline(lineStream, fileName);
+			fileSizes[fileName] = size;
+		}
+		else if (key == "seed") {
+			lineStream >> runSeed;
+		}
+		else if (key == "energy") {
+			double energy;
+			uint64_t energyEvents;
+			lineStream >> energy >> energyEvents;
+			energyProgress[energy] = energyEvents;
+		}
+	}
+	return true;
+}
+
+void OTPCCheckpoint::restore() {
+	for (const auto& entry : std::filesystem::directory_iterator(runDirectoryPath)) {
+		if (!entry.is_regular_file() || !isOutputFile(entry.path())) {
+			continue;
+		}
+		auto fileSize = fileSizes.find(entry.path().filename().string());
+		if (fileSize == fileSizes.end()) {
+			// written after the checkpoint (new energy point or unmerged shard)
+			std::filesystem::remove(entry.path());
+		}
+		else if (entry.file_size() != fileSize->second) {
+			std::cout << std::format("Truncating {} to {} bytes\n", entry.path().string(), fileSize->second);
+			std::filesystem::resize_file(entry.path(), fileSize->second);
+		}
+	}
+	std::cout << std::format("Resuming from run {} after {} events\n", setupIndex, completedEvents);
+}
+
+uint64_t OTPCCheckpoint::getSetupIndex() const {
+	return setupIndex;
+}
+
+uint64_t OTPCCheckpoint::getCompletedEvents() const {
+	return completedEvents;
+}
+
+uint64_t OTPCCheckpoint::getRunSeed() const {
+	return runSeed;
+}
+
+void OTPCCheckpoint::setEnergyProgress(double energy, uint64_t completedEventsArg) {
+	energyProgress[energy] = completedEventsArg;
+}
+
+uint64_t OTPCCheckpoint::getEnergyProgress(double energy) const {
+	auto progress = energyProgress.find(energy);
+	return progress == energyProgress.end() ? 0 : progress->second;
+}
@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Compact encoding of event records
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCCompactEncoder.hh"
+
+#include <iostream>
+#include <format>
+#include <cstring>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const double
+		maximalTheta = 180, // primary angles are in degrees
+		maximalPhi = 360,
+		angleSteps = 65535;
+
+	uint16_t encodeAngle(double angle, double range) {
+		return uint16_t(std::lround(std::clamp(angle / range, 0., 1.) * angleSteps));
+	}
+
+	double decodeAngle(uint16_t value, double range) {
+		return value / angleSteps * range;
+	}
+}
+
+OTPCCompactEncoder::OTPCCompactEncoder(double fixedPointStepArg) : fixedPointStep(fixedPointStepArg) {}
+
+OTPCCompactEncoder::OTPCCompactEncoder(const std::string& description) : fixedPointStep(0) {
+	// layout of the record may precede the deposit encoding, e.g. "hitmask/float32"
+	auto depositEncoding = description.substr(description.find('/') + 1);
+	if (depositEncoding.starts_with("fixed:")) {
+		fixedPointStep = std::stod(depositEncoding.substr(6));
+	}
+	else if (depositEncoding != "float32") {
+		std::cout << "Unknown compact encoding " << description << _endl_;
+		exit(1);
+	}
+}
+
+std::string OTPCCompactEncoder::describe() const {
+	return fixedPointStep > 0 ? std::format("fixed:{}", fixedPointStep) : "float32";
+}
+
+void OTPCCompactEncoder::encodeDeposit(double deposit, char* out) const {
+	uint32_t value;
+	if (fixedPointStep > 0) {
+		value = uint32_t(std::clamp(std::llround(deposit / fixedPointStep), 0ll, (long long)UINT32_MAX));
+	}
+	else {
+		value = std::bit_cast<uint32_t>(float(deposit));
+	}
+	std::memcpy(out, &value, depositSize);
+}
+
+double OTPCCompactEncoder::decodeDeposit(const char* in) const {
+	uint32_t value;
+	std::memcpy(&value, in, depositSize);
+	return fixedPointStep > 0 ? value * fixedPointStep : double(std::bit_cast<float>(value));
+}
+
+void OTPCCompactEncoder::encodeCrystals(const std::array<double, numberOfCrystals>& deposits, std::vector<char>& record) const {
+	uint32_t hitMask = 0;
+	record.resize(sizeof(hitMask));
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		char value[depositSize];
+		encodeDeposit(deposits[crystal], value);
+		// a deposit below the precision counts as no hit, so decoding gives back the same mask
+		if (decodeDeposit(value) != 0) {
+			hitMask |= 1u << crystal;
+			record.insert(record.end(), value, value + depositSize);
+		}
+	}
+	std::memcpy(record.data(), &hitMask, sizeof(hitMask));
+}
+
+std::array<double, OTPCCompactEncoder::numberOfCrystals> OTPCCompactEncoder::decodeCrystals(const char* record, std::size_t size) const {
+	std::array<double, numberOfCrystals> deposits{};
+	uint32_t hitMask;
+	std::memcpy(&hitMask, record, sizeof(hitMask));
+	if (size != sizeof(hitMask) + depositSize * std::popcount(hitMask)) {
+		std::cout << "Corrupted compact crystal record" << _endl_;
+		exit(1);
+	}
+	auto value = record + sizeof(hitMask);
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		if (hitMask & (1u << crystal)) {
+			deposits[crystal] = decodeDeposit(value);
+			value += depositSize;
+		}
+	}
+	return deposits;
+}
+
+void OTPCCompactEncoder::encodeGas(double deposit, char* record) const {
+	encodeDeposit(deposit, record);
+}
+
+double OTPCCompactEncoder::decodeGas(const char* record) const {
+	return decodeDeposit(record);
+}
+
+void OTPCCompactEncoder::encodePrimary(const std::array<double, 12>& primaryInfo, char* record) {
+	// E[0..2] in keV and position in mm as float32, theta[0..2] and phi[0..2] in degrees as uint16
+	for (std::size_t i = 0; i < 6; i++) {
+		float value = float(primaryInfo[i]);
+		std::memcpy(record + 4 * i, &value, sizeof(value));
+	}
+	for (std::size_t i = 0; i < 6; i++) {
+		uint16_t value = encodeAngle(primaryInfo[6 + i], i < 3 ? maximalTheta : maximalPhi);
+		std::memcpy(record + 24 + 2 * i, &value, sizeof(value));
+	}
+}
+
+std::array<double, 12> OTPCCompactEncoder::decodePrimary(const char* record) {
+	std::array<double, 12> primaryInfo;
+	for (std::size_t i = 0; i < 6; i++) {
+		float value;
+		std::memcpy(&value, record + 4 * i, sizeof(value));
+		primaryInfo[i] = value;
+	}
+	for (std::size_t i = 0; i < 6; i++) {
+		uint16_t value;
+		std::memcpy(&value, record + 24 + 2 * i, sizeof(value));
+		primaryInfo[6 + i] = decodeAngle(value, i < 3 ? maximalTheta : maximalPhi);
+	}
+	return primaryInfo;
+}
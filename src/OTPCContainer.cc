@@ -0,0 +1,409 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Self-describing event container
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCContainer.hh"
+
+#include <zlib.h>
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const char
+		headerMagic[8] = { 'O', 'T', 'P', 'C', 'E', 'V', 'T', '1' },
+		footerMagic[8] = { 'O', 'T', 'P', 'C', 'I', 'D', 'X', '1' };
+	const uint32_t containerVersion = 1;
+	const int compressionLevel = 1; // speed matters more than ratio, shuffling does most of the work
+
+	template <typename T>
+	void writeValue(std::ostream& stream, const T& value) {
+		stream.write((const char*)&value, sizeof(value));
+	}
+
+	template <typename T>
+	T readValue(std::istream& stream) {
+		T value{};
+		stream.read((char*)&value, sizeof(value));
+		return value;
+	}
+
+	void writeHeader(std::ostream& stream, uint32_t eventsPerChunk, const std::vector<OTPCColumn>& schema) {
+		stream.write(headerMagic, sizeof(headerMagic));
+		writeValue(stream, containerVersion);
+		writeValue(stream, eventsPerChunk);
+		writeValue(stream, uint32_t(schema.size()));
+		for (const auto& column : schema) {
+			writeValue(stream, uint32_t(column.name.size()));
+			stream.write(column.name.data(), column.name.size());
+			writeValue(stream, column.type);
+			writeValue(stream, column.elementsPerEvent);
+			writeValue(stream, uint32_t(column.encoding.size()));
+			stream.write(column.encoding.data(), column.encoding.size());
+		}
+	}
+
+	bool readHeader(std::istream& stream, uint32_t& version, uint32_t& eventsPerChunk, std::vector<OTPCColumn>& schema) {
+		char magic[sizeof(headerMagic)];
+		stream.read(magic, sizeof(magic));
+		if (!stream || std::memcmp(magic, headerMagic, sizeof(magic)) != 0) {
+			return false;
+		}
+		version = readValue<uint32_t>(stream);
+		if (version != containerVersion) {
+			return false;
+		}
+		eventsPerChunk = readValue<uint32_t>(stream);
+		schema.resize(readValue<uint32_t>(stream));
+		for (auto& column : schema) {
+			column.name.resize(readValue<uint32_t>(stream));
+			stream.read(column.name.data(), column.name.size());
+			column.type = readValue<OTPCColumnType>(stream);
+			column.elementsPerEvent = readValue<uint32_t>(stream);
+			column.encoding.resize(readValue<uint32_t>(stream));
+			stream.read(column.encoding.data(), column.encoding.size());
+		}
+		return bool(stream);
+	}
+
+	// chunks appended since the previous footer, linked to it
+	void writeFooter(std::ostream& stream, uint64_t previousFooterOffset, const std::vector<OTPCChunkEntry>& chunks) {
+		uint64_t footerOffset = stream.tellp();
+		writeValue(stream, previousFooterOffset);
+		writeValue(stream, uint64_t(chunks.size()));
+		for (const auto& chunk : chunks) {
+			writeValue(stream, chunk.column);
+			writeValue(stream, chunk.energy);
+			writeValue(stream, chunk.firstEvent);
+			writeValue(stream, chunk.lastEvent);
+			writeValue(stream, chunk.eventCount);
+			writeValue(stream, chunk.offset);
+			writeValue(stream, chunk.compressedSize);
+			writeValue(stream, chunk.rawSize);
+			writeValue(stream, chunk.crc);
+		}
+		writeValue(stream, footerOffset);
+		stream.write(footerMagic, sizeof(footerMagic));
+	}
+
+	// follows the footers from the last one back to the first, chunks are returned in the order they were written
+	bool readFooters(std::istream& stream, uint64_t& lastFooterOffset, std::vector<OTPCChunkEntry>& chunks) {
+		stream.seekg(-std::streamoff(sizeof(uint64_t) + sizeof(footerMagic)), std::ios_base::end);
+		lastFooterOffset = readValue<uint64_t>(stream);
+		char magic[sizeof(footerMagic)];
+		stream.read(magic, sizeof(magic));
+		if (!stream || std::memcmp(magic, footerMagic, sizeof(magic)) != 0) {
+			return false;
+		}
+		std::vector<std::vector<OTPCChunkEntry>> footers;
+		for (auto footerOffset = lastFooterOffset; footerOffset != 0;) {
+			stream.seekg(footerOffset);
+			auto previousFooterOffset = readValue<uint64_t>(stream);
+			if (!stream || previousFooterOffset >= footerOffset) {
+				return false; // links point back only, anything else is corruption
+			}
+			auto& footerChunks = footers.emplace_back(readValue<uint64_t>(stream));
+			for (auto& chunk : footerChunks) {
+				chunk.column = readValue<uint32_t>(stream);
+				chunk.energy = readValue<double>(stream);
+				chunk.firstEvent = readValue<uint64_t>(stream);
+				chunk.lastEvent = readValue<uint64_t>(stream);
+				chunk.eventCount = readValue<uint64_t>(stream);
+				chunk.offset = readValue<uint64_t>(stream);
+				chunk.compressedSize = readValue<uint64_t>(stream);
+				chunk.rawSize = readValue<uint64_t>(stream);
+				chunk.crc = readValue<uint32_t>(stream);
+			}
+			if (!stream) {
+				return false;
+			}
+			footerOffset = previousFooterOffset;
+		}
+		chunks.clear();
+		for (auto footer = footers.rbegin(); footer != footers.rend(); footer++) {
+			chunks.insert(chunks.end(), footer->begin(), footer->end());
+		}
+		return true;
+	}
+
+	// groups the n-th bytes of all elements together, floating point data compresses much better this way
+	std::vector<char> shuffle(const std::vector<char>& data, std::size_t elementSize) {
+		std::vector<char> shuffled(data.size());
+		auto elements = data.size() / elementSize;
+		for (std::size_t i = 0; i < elements; i++) {
+			for (std::size_t b = 0; b < elementSize; b++) {
+				shuffled[b * elements + i] = data[i * elementSize + b];
+			}
+		}
+		return shuffled;
+	}
+
+	std::vector<char> unshuffle(const std::vector<char>& shuffled, std::size_t elementSize) {
+		std::vector<char> data(shuffled.size());
+		auto elements = data.size() / elementSize;
+		for (std::size_t i = 0; i < elements; i++) {
+			for (std::size_t b = 0; b < elementSize; b++) {
+				data[i * elementSize + b] = shuffled[b * elements + i];
+			}
+		}
+		return data;
+	}
+}
+
+std::size_t OTPCColumn::elementSize() const {
+	switch (type) {
+	case OTPCColumnType::float64:
+	case OTPCColumnType::uint64:
+		return 8;
+	case OTPCColumnType::float32:
+	case OTPCColumnType::uint32:
+		return 4;
+	case OTPCColumnType::uint16:
+		return 2;
+	case OTPCColumnType::variable:
+		return 1;
+	default:
+		return 1;
+	}
+}
+
+std::size_t OTPCColumn::recordSize() const {
+	return elementSize() * elementsPerEvent;
+}
+
+OTPCContainerWriter::OTPCContainerWriter(const std::filesystem::path& filePathArg, const std::vector<OTPCColumn>& schemaArg, uint32_t eventsPerChunkArg) :
+	filePath(filePathArg),
+	schema(schemaArg),
+	eventsPerChunk(eventsPerChunkArg)
+{
+	if (std::filesystem::exists(filePath) && std::filesystem::file_size(filePath) > 0) {
+		file.open(filePath, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		std::vector<OTPCColumn> existingSchema;
+		std::vector<OTPCChunkEntry> existingChunks;
+		uint32_t version;
+		if (!readHeader(file, version, eventsPerChunk, existingSchema) || !readFooters(file, previousFooterOffset, existingChunks)) {
+			std::cout << "Corrupted container " << filePath << ", restore it from a checkpoint or remove it" << _endl_;
+			exit(1);
+		}
+		auto sameColumn = [](const OTPCColumn& a, const OTPCColumn& b) {
+			return a.name == b.name && a.type == b.type && a.elementsPerEvent == b.elementsPerEvent && a.encoding == b.encoding;
+		};
+		if (!std::equal(schema.begin(), schema.end(), existingSchema.begin(), existingSchema.end(), sameColumn)) {
+			std::cout << "Container " << filePath << " has a different schema (output settings changed?)" << _endl_;
+			exit(1);
+		}
+		// the previous footer stays in place, so the file can be truncated back to it
+		file.seekp(0, std::ios_base::end);
+		hasFooter = true;
+	}
+	else {
+		file.open(filePath, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open()) {
+			std::cout << "Cannot create container " << filePath << _endl_;
+			exit(1);
+		}
+		writeHeader(file, eventsPerChunk, schema);
+	}
+}
+
+OTPCContainerWriter::~OTPCContainerWriter() {
+	close();
+}
+
+uint32_t OTPCContainerWriter::getEventsPerChunk() const {
+	return eventsPerChunk;
+}
+
+const std::vector<OTPCColumn>& OTPCContainerWriter::getSchema() const {
+	return schema;
+}
+
+void OTPCContainerWriter::appendChunk(uint32_t column, double energy, uint64_t firstEvent, uint64_t lastEvent, uint64_t eventCount, const std::vector<char>& rawData) {
+	OTPCChunkEntry chunk;
+	chunk.column = column;
+	chunk.energy = energy;
+	chunk.firstEvent = firstEvent;
+	chunk.lastEvent = lastEvent;
+	chunk.eventCount = eventCount;
+	chunk.rawSize = rawData.size();
+	chunk.crc = uint32_t(crc32(0, (const Bytef*)rawData.data(), uInt(rawData.size())));
+
+	auto shuffled = shuffle(rawData, schema[column].elementSize());
+	uLongf compressedSize = compressBound(uLong(shuffled.size()));
+	std::vector<char> compressed(compressedSize);
+	if (compress2((Bytef*)compressed.data(), &compressedSize, (const Bytef*)shuffled.data(), uLong(shuffled.size()), compressionLevel) != Z_OK) {
+		std::cout << "Compression of chunk failed" << _endl_;
+		exit(1);
+	}
+	chunk.compressedSize = compressedSize;
+
+	std::lock_guard lock(fileMutex);
+	file.seekp(0, std::ios_base::end);
+	chunk.offset = file.tellp();
+	file.write(compressed.data(), compressedSize);
+	chunks.push_back(chunk);
+}
+
+void OTPCContainerWriter::close() {
+	if (!file.is_open()) {
+		return;
+	}
+	// the previous footer still indexes the whole file if nothing was appended
+	if (!chunks.empty() || !hasFooter) {
+		file.seekp(0, std::ios_base::end);
+		writeFooter(file, previousFooterOffset, chunks);
+	}
+	file.close();
+	if (!file) {
+		std::cout << "Writing of container " << filePath << " failed" << _endl_;
+		exit(1);
+	}
+}
+
+OTPCContainerReader::OTPCContainerReader(const std::filesystem::path& filePathArg) : filePath(filePathArg) {
+	file.open(filePath, std::ios_base::in | std::ios_base::binary);
+	uint32_t version;
+	uint64_t lastFooterOffset;
+	if (!file.is_open() || !readHeader(file, version, eventsPerChunk, schema) || !readFooters(file, lastFooterOffset, chunks)) {
+		std::cout << "Cannot read container " << filePath << _endl_;
+		exit(1);
+	}
+}
+
+const std::vector<OTPCColumn>& OTPCContainerReader::getSchema() const {
+	return schema;
+}
+
+uint32_t OTPCContainerReader::getColumnIndex(const std::string& name) const {
+	for (uint32_t i = 0; i < schema.size(); i++) {
+		if (schema[i].name == name) {
+			return i;
+		}
+	}
+	std::cout << "No column " << name << " in " << filePath << _endl_;
+	exit(1);
+}
+
+const std::vector<OTPCChunkEntry>& OTPCContainerReader::getChunks() const {
+	return chunks;
+}
+
+std::vector<double> OTPCContainerReader::getEnergies() const {
+	std::vector<double> energies;
+	for (const auto& chunk : chunks) {
+		if (std::find(energies.begin(), energies.end(), chunk.energy) == energies.end()) {
+			energies.push_back(chunk.energy);
+		}
+	}
+	return energies;
+}
+
+uint64_t OTPCContainerReader::getEventCount(uint32_t column, double energy) const {
+	uint64_t events = 0;
+	for (const auto& chunk : chunks) {
+		if (chunk.column == column && chunk.energy == energy) {
+			events += chunk.eventCount;
+		}
+	}
+	return events;
+}
+
+bool decodeChunk(const OTPCChunkEntry& chunk, std::size_t elementSize, const char* compressed, std::vector<char>& data) {
+	std::vector<char> shuffled(chunk.rawSize);
+	uLongf rawSize = uLongf(chunk.rawSize);
+	if (uncompress((Bytef*)shuffled.data(), &rawSize, (const Bytef*)compressed, uLong(chunk.compressedSize)) != Z_OK || rawSize != chunk.rawSize) {
+		return false;
+	}
+	data = unshuffle(shuffled, elementSize);
+	return uint32_t(crc32(0, (const Bytef*)data.data(), uInt(data.size()))) == chunk.crc;
+}
+
+std::vector<char> OTPCContainerReader::readChunk(const OTPCChunkEntry& chunk) {
+	std::vector<char> compressed(chunk.compressedSize);
+	file.clear();
+	file.seekg(chunk.offset);
+	file.read(compressed.data(), compressed.size());
+
+	std::vector<char> data;
+	if (!file || !decodeChunk(chunk, schema[chunk.column].elementSize(), compressed.data(), data)) {
+		std::cout << std::format("Cannot decode chunk at {} of {}", chunk.offset, filePath.string()) << _endl_;
+		exit(1);
+	}
+	return data;
+}
+
+std::vector<char> OTPCContainerReader::readEvents(uint32_t column, double energy, uint64_t firstEvent, uint64_t eventCount) {
+	auto lastEvent = firstEvent + eventCount - 1;
+	std::vector<const OTPCChunkEntry*> selected;
+	for (const auto& chunk : chunks) {
+		if (chunk.column == column && chunk.energy == energy && chunk.firstEvent <= lastEvent && chunk.lastEvent >= firstEvent) {
+			selected.push_back(&chunk);
+		}
+	}
+	std::sort(selected.begin(), selected.end(), [](auto a, auto b) { return a->firstEvent < b->firstEvent; });
+
+	std::vector<char> records;
+	for (auto chunk : selected) {
+		auto data = readChunk(*chunk);
+		auto offsets = recordOffsets(column, data);
+		if (chunk->lastEvent - chunk->firstEvent + 1 == chunk->eventCount) {
+			auto begin = std::max(firstEvent, chunk->firstEvent) - chunk->firstEvent;
+			auto end = std::min(lastEvent, chunk->lastEvent) + 1 - chunk->firstEvent;
+			records.insert(records.end(), data.begin() + offsets[begin], data.begin() + offsets[end]);
+			continue;
+		}
+		// chunks of all columns of an energy hold the same events, the event numbers are in the "event" column
+		auto eventColumn = getColumnIndex("event");
+		auto eventChunk = std::find_if(chunks.begin(), chunks.end(), [&](const OTPCChunkEntry& other) {
+			return other.column == eventColumn && other.energy == energy && other.firstEvent == chunk->firstEvent;
+		});
+		if (eventChunk == chunks.end()) {
+			std::cout << std::format("No event numbers of chunk at {} of {}", chunk->offset, filePath.string()) << _endl_;
+			exit(1);
+		}
+		auto eventData = readChunk(*eventChunk);
+		auto eventNumbers = (const uint64_t*)eventData.data();
+		for (std::size_t row = 0; row < chunk->eventCount; row++) {
+			if (eventNumbers[row] >= firstEvent && eventNumbers[row] <= lastEvent) {
+				records.insert(records.end(), data.begin() + offsets[row], data.begin() + offsets[row + 1]);
+			}
+		}
+	}
+	return records;
+}
+
+std::vector<std::size_t> OTPCContainerReader::recordOffsets(uint32_t column, const std::vector<char>& data) const {
+	std::vector<std::size_t> offsets = { 0 };
+	auto recordSize = schema[column].recordSize();
+	while (offsets.back() < data.size()) {
+		if (recordSize > 0) {
+			offsets.push_back(offsets.back() + recordSize);
+		}
+		else {
+			uint16_t size;
+			std::memcpy(&size, data.data() + offsets.back(), sizeof(size));
+			offsets.push_back(offsets.back() + sizeof(size) + size);
+		}
+	}
+	return offsets;
+}
+
+std::vector<std::string_view> OTPCContainerReader::splitRecords(uint32_t column, const std::vector<char>& data) const {
+	std::vector<std::string_view> records;
+	auto offsets = recordOffsets(column, data);
+	auto prefixSize = schema[column].recordSize() > 0 ? 0 : sizeof(uint16_t);
+	for (std::size_t i = 0; i + 1 < offsets.size(); i++) {
+		records.emplace_back(data.data() + offsets[i] + prefixSize, offsets[i + 1] - offsets[i] - prefixSize);
+	}
+	return records;
+}
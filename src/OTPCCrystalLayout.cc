@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Arrangement of the gamma detectors by placement copy number
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCCrystalLayout.hh"
+
+#include <cstdlib>
+#include <bit>
+
+OTPCCrystalLayout::OTPCCrystalLayout() {
+	// same loops as the gamma detector placements, copy numbers are given in this order
+	std::size_t crystal = 0;
+	for (auto side : { -1, 1 }) {
+		for (auto row : { -1, 1 }) {
+			for (int column = 0; column < 6; column++) {
+				if (side < 0 && (column == 2 || column == 3)) {
+					continue;
+				}
+				positions[crystal++] = { side, row, column };
+			}
+		}
+	}
+	for (std::size_t a = 0; a < numberOfCrystals; a++) {
+		neighbourMasks[a] = 0;
+		for (std::size_t b = 0; b < numberOfCrystals; b++) {
+			auto& pa = positions[a];
+			auto& pb = positions[b];
+			bool neighbours = pa.side == pb.side && (
+				(pa.row == pb.row && std::abs(pa.column - pb.column) == 1) ||
+				(pa.row != pb.row && pa.column == pb.column));
+			neighbourMasks[a] |= uint32_t(neighbours) << b;
+		}
+	}
+}
+
+const OTPCCrystalLayout& OTPCCrystalLayout::get() {
+	static const OTPCCrystalLayout layout;
+	return layout;
+}
+
+const OTPCCrystalLayout::CrystalPosition& OTPCCrystalLayout::getPosition(std::size_t crystal) const {
+	return positions[crystal];
+}
+
+bool OTPCCrystalLayout::areNeighbours(std::size_t a, std::size_t b) const {
+	return neighbourMasks[a] & (1u << b);
+}
+
+void OTPCCrystalLayout::addback(const double* deposits, double threshold, std::vector<double>& clusters) const {
+	clusters.clear();
+	uint32_t hitMask = 0;
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		hitMask |= uint32_t(deposits[crystal] > threshold) << crystal;
+	}
+	// connected components of the hit crystals, grown one neighbourhood at a time
+	while (hitMask) {
+		uint32_t cluster = hitMask & -hitMask, grown = 0;
+		while (grown != cluster) {
+			grown = cluster;
+			for (auto remaining = cluster; remaining; remaining &= remaining - 1) {
+				cluster |= neighbourMasks[std::countr_zero(remaining)] & hitMask;
+			}
+		}
+		hitMask &= ~cluster;
+		double energy = 0;
+		for (; cluster; cluster &= cluster - 1) {
+			energy += deposits[std::countr_zero(cluster)];
+		}
+		clusters.push_back(energy);
+	}
+}
@@ -42,6 +42,9 @@
 #include "G4Polycone.hh"
 
 #include "F02ElectricFieldSetup.hh"
+#include "OTPCSensitiveDetector.hh"
+#include "OTPCCrystalLayout.hh"
+#include "G4SDManager.hh"
 #include <tuple>
 #include <map>
 #include <functional>
@@ -478,7 +481,7 @@ G4VPhysicalVolume* OTPCDetectorConstruction::Construct() {
 	// GAS OTPC 
 	//////////Reading the input data for primary generator///////////
 
-	std::ifstream geoInputFile("../../../geo.data");
+	std::ifstream geoInputFile(getGeometryFilePath());
 
 	if (!geoInputFile.is_open()) {
 		std::cout << "\n\nNO GEO INPUT INFORMATION FILE FOUND!!!" << _endl_;
@@ -675,6 +678,10 @@ G4VPhysicalVolume* OTPCDetectorConstruction::Construct() {
 		oneElectrodePlaneInternalVolumeSolid->GetXHalfLength() - 1 * cm,
 		oneElectrodePlaneInternalVolumeSolid->GetYHalfLength() - 1 * cm,
 		activeVolumeSolid->GetZHalfLength() - 1 * cm };
+	activeVolumeHalfSize = {
+		activeVolumeSolid->GetXHalfLength(),
+		activeVolumeSolid->GetYHalfLength(),
+		activeVolumeSolid->GetZHalfLength() };
 
 	//<--------------------------------------------------------------------------------------------------------------------------------->
 	//<---------------------------------------------------------Gamma detectors--------------------------------------------------------->
@@ -723,6 +730,16 @@ G4VPhysicalVolume* OTPCDetectorConstruction::Construct() {
 			}
 		}
 	}
+	// deposits are indexed by copy number, the table fails here instead of writing past the crystal arrays
+	crystalIndices.assign(gammaDetectorPlacementCounter, -1);
+	for (auto placement : gammaDetectorPlacements) {
+		auto copyNumber = placement->GetCopyNo();
+		if (copyNumber < 0 || copyNumber >= G4int(OTPCCrystalLayout::numberOfCrystals)) {
+			std::cout << "Error: gamma detector copy number " << copyNumber << " is not a crystal index" << _endl_;
+			exit(1);
+		}
+		crystalIndices[copyNumber] = copyNumber;
+	}
 
 	//<---------------------------------------------------------Crystal----------------------------------------------------------------->
 
@@ -839,6 +856,24 @@ G4VPhysicalVolume* OTPCDetectorConstruction::Construct() {
 	return physiWorld;
 }
 
+void OTPCDetectorConstruction::ConstructSDandField() {
+	if (!runConfiguration) {
+		std::cout << "Error: run configuration of the detector not set" << _endl_;
+		exit(1);
+	}
+	// steps of other volumes never reach the scoring
+	auto crystalDetector = new OTPCCrystalSensitiveDetector("crystals", crystalIndices);
+	G4SDManager::GetSDMpointer()->AddNewDetector(crystalDetector);
+	SetSensitiveDetector("crystalVolumeLogical", crystalDetector);
+	auto gasDetector = new OTPCGasSensitiveDetector("gas", *runConfiguration);
+	G4SDManager::GetSDMpointer()->AddNewDetector(gasDetector);
+	SetSensitiveDetector("activeVolumeLogical", gasDetector);
+}
+
+void OTPCDetectorConstruction::setRunConfiguration(const OTPCRunConfiguration& config) {
+	runConfiguration = &config;
+}
+
 const G4double OTPCDetectorConstruction::getCrystalDepth() {
 	if (isInitialized) {
 		return crystalDepth;
@@ -925,3 +960,17 @@ G4ThreeVector OTPCDetectorConstruction::getChamberCorner() {
 		exit(1);
 	}
 }
+
+G4ThreeVector OTPCDetectorConstruction::getActiveVolumeHalfSize() {
+	if (isInitialized) {
+		return activeVolumeHalfSize;
+	}
+	else {
+		std::cout << "Error: detector not constructed" << _endl_;
+		exit(1);
+	}
+}
+
+std::filesystem::path OTPCDetectorConstruction::getGeometryFilePath() {
+	return "../../../geo.data";
+}
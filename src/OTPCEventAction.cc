@@ -31,25 +31,33 @@
 #include <numeric>
 
 
-OTPCEventAction::OTPCEventAction(OTPCRunAction* RunAct) : runAction(RunAct) {}
+namespace {
+	// initial capacity of the per-event buffers
+	const std::size_t
+		stepBufferSize = 1 << 14,
+		voxelBufferSize = 1 << 14;
+}
+
+OTPCEventAction::OTPCEventAction(OTPCRunAction* RunAct) : runAction(RunAct) {
+	ProcessStep.reserve(stepBufferSize);
+	VoxelDeposits.reserve(voxelBufferSize);
+}
 
 void OTPCEventAction::BeginOfEventAction(const G4Event*) {
-	EnergyDeposit.clear();
 	ProcessStep.clear();
+	VoxelDeposits.clear();
 	TotalEnergyDepositCrystal.fill(0);
 	TotalEnergyDepositGas = 0;
 	internalFlag = false;
+	decayFlag = false;
 }
 
 void OTPCEventAction::EndOfEventAction(const G4Event* evt) {
 
-	//runAction->fillOut(EnergyDeposit, TotalEnergyDepositCrystal);
 	G4double totalEnergy = std::reduce(TotalEnergyDepositCrystal.begin(), TotalEnergyDepositCrystal.end());
-	runAction->fillOutSteps(ProcessStep, totalEnergy);
-	runAction->fillOutGasIonization(TotalEnergyDepositGas);
-	if (includeZeroEnergy || totalEnergy > 0) {
-		runAction->fillOutScintillation(TotalEnergyDepositCrystal);
-	}
+	runAction->fillOutSteps(ProcessStep, decayFlag, totalEnergy, evt->GetEventID());
+	runAction->fillOutEvent(TotalEnergyDepositCrystal, TotalEnergyDepositGas, includeZeroEnergy || totalEnergy > 0, evt->GetEventID());
+	runAction->fillOutVoxels(VoxelDeposits);
 	runAction->updateEventCounter(internalFlag);
 
 }
@@ -62,16 +70,20 @@ void OTPCEventAction::depositEnergyOnGas(G4double edep) {
 	TotalEnergyDepositGas += edep;
 }
 
+void OTPCEventAction::depositEnergyOnVoxel(uint32_t voxel, G4double edep) {
+	VoxelDeposits.push_back({ voxel, edep });
+}
+
 void OTPCEventAction::setFlag() {
 	internalFlag = true;
 }
 
-void OTPCEventAction::addEdep(G4double Edep, G4double x, G4double y, G4double z) {
-	EnergyDeposit.push_back({ Edep, x, y, z });
+void OTPCEventAction::setDecay() {
+	decayFlag = true;
 }
 
-void OTPCEventAction::addProcess(G4double x, G4double y, G4double z, G4String name) {
-	ProcessStep.push_back({ x,y,z,name });
+void OTPCEventAction::addProcess(G4double x, G4double y, G4double z, uint16_t process, uint16_t particle) {
+	ProcessStep.push_back({ x, y, z, process, particle });
 }
 
 
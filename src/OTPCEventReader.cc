@@ -0,0 +1,234 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Memory-mapped reader of run containers
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCEventReader.hh"
+
+#include <fstream>
+#include <iostream>
+#include <cstring>
+#include <format>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCMappedFile::OTPCMappedFile(const std::filesystem::path& filePath) {
+	mappingSize = std::filesystem::file_size(filePath);
+#ifdef __linux__
+	int descriptor = ::open(filePath.c_str(), O_RDONLY);
+	if (descriptor < 0) {
+		std::cout << "Cannot open " << filePath << _endl_;
+		exit(1);
+	}
+	void* address = mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, descriptor, 0);
+	::close(descriptor); // the mapping keeps the file open
+	if (address == MAP_FAILED) {
+		std::cout << "Cannot map " << filePath << _endl_;
+		exit(1);
+	}
+	// chunks are decoded in no particular order, readahead of the whole file does not pay off
+	madvise(address, mappingSize, MADV_RANDOM);
+	mapping = (const char*)address;
+#else
+	contents.resize(mappingSize);
+	std::ifstream file(filePath, std::ios_base::in | std::ios_base::binary);
+	if (!file.read(contents.data(), contents.size())) {
+		std::cout << "Cannot read " << filePath << _endl_;
+		exit(1);
+	}
+	mapping = contents.data();
+#endif
+}
+
+OTPCMappedFile::~OTPCMappedFile() {
+#ifdef __linux__
+	munmap((void*)mapping, mappingSize);
+#endif
+}
+
+const char* OTPCMappedFile::data() const {
+	return mapping;
+}
+
+std::size_t OTPCMappedFile::size() const {
+	return mappingSize;
+}
+
+std::size_t OTPCEventBlock::size() const {
+	return eventCount;
+}
+
+std::span<const double> OTPCEventBlock::crystalDeposits() const {
+	return view<double>(crystalsData);
+}
+
+std::span<const double> OTPCEventBlock::gasDeposits() const {
+	return view<double>(gasData);
+}
+
+std::span<const double> OTPCEventBlock::primaryInfo() const {
+	return view<double>(primaryData);
+}
+
+std::span<const uint8_t> OTPCEventBlock::triggerDecisions() const {
+	return view<uint8_t>(triggerData);
+}
+
+std::span<const double, OTPCEventBlock::crystalsPerEvent> OTPCEventBlock::crystals(std::size_t index) const {
+	return crystalDeposits().subspan(index * crystalsPerEvent).first<crystalsPerEvent>();
+}
+
+double OTPCEventBlock::gas(std::size_t index) const {
+	return gasDeposits()[index];
+}
+
+std::span<const double, OTPCEventBlock::primaryValuesPerEvent> OTPCEventBlock::primary(std::size_t index) const {
+	return primaryInfo().subspan(index * primaryValuesPerEvent).first<primaryValuesPerEvent>();
+}
+
+uint64_t OTPCEventBlock::eventNumber(std::size_t index) const {
+	// without trigger there are no gaps in the events
+	return eventData.empty() ? firstEvent + index : view<uint64_t>(eventData)[index];
+}
+
+OTPCEventReader::OTPCEventReader(const std::filesystem::path& containerPath) :
+	filePath(containerPath),
+	file(containerPath)
+{
+	{
+		// the index is small, it is read the usual way
+		OTPCContainerReader container(filePath);
+		schema = container.getSchema();
+		chunks = container.getChunks();
+		energies = container.getEnergies();
+	}
+	const std::array<std::string, numberOfColumns> columnNames = { "crystals", "gas", "primary", "event", "trigger" };
+	for (std::size_t column = 0; column < numberOfColumns; column++) {
+		for (uint32_t i = 0; i < schema.size(); i++) {
+			if (schema[i].name == columnNames[column]) {
+				columns[column] = i;
+			}
+		}
+	}
+	if (!columns[crystalsColumn] || !columns[gasColumn] || !columns[primaryColumn]) {
+		std::cout << "Container " << filePath << " has no event columns" << _endl_;
+		exit(1);
+	}
+	if (schema[*columns[crystalsColumn]].type == OTPCColumnType::variable) {
+		crystalsEncoder.emplace(schema[*columns[crystalsColumn]].encoding);
+		gasEncoder.emplace(schema[*columns[gasColumn]].encoding);
+	}
+
+	// chunks of all columns are cut at the same events, so a block is identified by energy and first event
+	std::map<std::pair<double, uint64_t>, Block> blocksByFirstEvent;
+	for (const auto& chunk : chunks) {
+		for (std::size_t column = 0; column < numberOfColumns; column++) {
+			if (columns[column] == chunk.column) {
+				auto [block, inserted] = blocksByFirstEvent.try_emplace({ chunk.energy, chunk.firstEvent });
+				if (inserted) {
+					block->second.fill(nullptr);
+				}
+				block->second[column] = &chunk;
+			}
+		}
+	}
+	for (const auto& [key, block] : blocksByFirstEvent) {
+		if (!block[crystalsColumn] || !block[gasColumn] || !block[primaryColumn] || (columns[eventColumn] && !block[eventColumn])) {
+			std::cout << std::format("Incomplete block of events from {} at {} MeV in {}", key.second, key.first, filePath.string()) << _endl_;
+			exit(1);
+		}
+		blocks[key.first].push_back(block);
+	}
+}
+
+std::vector<double> OTPCEventReader::getEnergies() const {
+	return energies;
+}
+
+uint64_t OTPCEventReader::getEventCount(double energy) const {
+	uint64_t events = 0;
+	auto energyBlocks = blocks.find(energy);
+	if (energyBlocks != blocks.end()) {
+		for (const auto& block : energyBlocks->second) {
+			events += block[crystalsColumn]->eventCount;
+		}
+	}
+	return events;
+}
+
+std::size_t OTPCEventReader::getBlockCount(double energy) const {
+	auto energyBlocks = blocks.find(energy);
+	return energyBlocks == blocks.end() ? 0 : energyBlocks->second.size();
+}
+
+std::vector<char> OTPCEventReader::decode(const OTPCChunkEntry& chunk) const {
+	std::vector<char> data;
+	if (chunk.offset + chunk.compressedSize > file.size() || !decodeChunk(chunk, schema[chunk.column].elementSize(), file.data() + chunk.offset, data)) {
+		std::cout << std::format("Cannot decode chunk at {} of {}", chunk.offset, filePath.string()) << _endl_;
+		exit(1);
+	}
+	return data;
+}
+
+OTPCEventBlock OTPCEventReader::readBlock(double energy, std::size_t blockIndex) const {
+	auto& block = blocks.at(energy).at(blockIndex);
+	OTPCEventBlock eventBlock;
+	eventBlock.energy = energy;
+	eventBlock.firstEvent = block[crystalsColumn]->firstEvent;
+	eventBlock.lastEvent = block[crystalsColumn]->lastEvent;
+	eventBlock.eventCount = block[crystalsColumn]->eventCount;
+
+	auto crystalsData = decode(*block[crystalsColumn]);
+	auto gasData = decode(*block[gasColumn]);
+	auto primaryData = decode(*block[primaryColumn]);
+	if (block[eventColumn]) {
+		eventBlock.eventData = decode(*block[eventColumn]);
+	}
+	if (block[triggerColumn]) {
+		eventBlock.triggerData = decode(*block[triggerColumn]);
+	}
+
+	if (!crystalsEncoder) {
+		// full-precision records are already laid out as the views expect them
+		eventBlock.crystalsData = std::move(crystalsData);
+		eventBlock.gasData = std::move(gasData);
+		eventBlock.primaryData = std::move(primaryData);
+		return eventBlock;
+	}
+
+	// compact records are expanded once per block
+	auto expand = [&](std::vector<char>& expanded, std::size_t valuesPerEvent, auto&& decodeEvent) {
+		expanded.resize(eventBlock.eventCount * valuesPerEvent * sizeof(double));
+		auto values = (double*)expanded.data();
+		for (std::size_t index = 0; index < eventBlock.eventCount; index++) {
+			decodeEvent(index, values + index * valuesPerEvent);
+		}
+	};
+	std::size_t crystalsOffset = 0;
+	expand(eventBlock.crystalsData, OTPCEventBlock::crystalsPerEvent, [&](std::size_t, double* values) {
+		uint16_t size;
+		std::memcpy(&size, crystalsData.data() + crystalsOffset, sizeof(size));
+		auto deposits = crystalsEncoder->decodeCrystals(crystalsData.data() + crystalsOffset + sizeof(size), size);
+		std::copy(deposits.begin(), deposits.end(), values);
+		crystalsOffset += sizeof(size) + size;
+	});
+	expand(eventBlock.gasData, 1, [&](std::size_t index, double* values) {
+		*values = gasEncoder->decodeGas(gasData.data() + index * OTPCCompactEncoder::depositSize);
+	});
+	expand(eventBlock.primaryData, OTPCEventBlock::primaryValuesPerEvent, [&](std::size_t index, double* values) {
+		auto primaryInfo = OTPCCompactEncoder::decodePrimary(primaryData.data() + index * OTPCCompactEncoder::primaryRecordSize);
+		std::copy(primaryInfo.begin(), primaryInfo.end(), values);
+	});
+	return eventBlock;
+}
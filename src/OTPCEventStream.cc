@@ -0,0 +1,256 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Live stream of written events through POSIX shared memory
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCEventStream.hh"
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <bit>
+#include <new>
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const char streamMagic[8] = { 'O', 'T', 'P', 'C', 'S', 'T', 'R', '1' };
+	const uint32_t streamVersion = 1;
+	// a consumer not polling for this long is considered gone, it may have crashed without detaching
+	const std::chrono::nanoseconds consumerTimeout = std::chrono::seconds(10);
+
+	// segment: header, ring headers, records of ring 0, records of ring 1, ...
+	struct alignas(64) SegmentHeader {
+		char magic[8];
+		uint32_t
+			version,
+			recordSize;
+		uint64_t
+			ringCount,
+			capacity;
+		std::atomic<uint32_t>
+			consumers,
+			closed;
+		std::atomic<int64_t> heartbeat; // steady clock (ns) of the last poll of any consumer
+	};
+
+	// indices on separate cache lines, so producer and consumer do not invalidate each other's
+	struct RingHeader {
+		alignas(64) std::atomic<uint64_t> head;    // next record to be written
+		alignas(64) std::atomic<uint64_t> tail;    // next record to be read
+		alignas(64) std::atomic<uint64_t> dropped;
+	};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+		"shared memory indices must be lock-free atomics");
+
+	std::size_t segmentSizeFor(std::size_t ringCount, std::size_t capacity) {
+		return sizeof(SegmentHeader) + ringCount * (sizeof(RingHeader) + capacity * sizeof(OTPCStreamRecord));
+	}
+
+	SegmentHeader& header(void* segment) {
+		return *(SegmentHeader*)segment;
+	}
+
+	RingHeader& ringHeader(void* segment, std::size_t ring) {
+		return ((RingHeader*)((char*)segment + sizeof(SegmentHeader)))[ring];
+	}
+
+	OTPCStreamRecord* ringRecords(void* segment, std::size_t ring) {
+		auto& segmentHeader = header(segment);
+		auto records = (OTPCStreamRecord*)((char*)segment + sizeof(SegmentHeader) + segmentHeader.ringCount * sizeof(RingHeader));
+		return records + ring * segmentHeader.capacity;
+	}
+
+	// steady clock is system-wide, so the producer and consumer processes compare the same time
+	int64_t steadyNow() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// block policy is honoured only while a consumer is attached and alive
+	bool isConsumerAlive(const SegmentHeader& segmentHeader) {
+		return segmentHeader.consumers.load(std::memory_order_relaxed) > 0 &&
+			steadyNow() - segmentHeader.heartbeat.load(std::memory_order_relaxed) <= consumerTimeout.count();
+	}
+
+	std::string sharedMemoryName(const std::string& name) {
+		return name.starts_with('/') ? name : '/' + name;
+	}
+}
+
+OTPCEventStream::OTPCEventStream(const std::string& nameArg, std::size_t rings, std::size_t capacity, Policy policyArg) :
+	name(sharedMemoryName(nameArg)),
+	policy(policyArg)
+{
+#ifdef __linux__
+	capacity = std::bit_ceil(std::max<std::size_t>(capacity, 1));
+	segmentSize = segmentSizeFor(rings, capacity);
+	// a segment left behind by a killed simulation is replaced
+	shm_unlink(name.c_str());
+	int descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (descriptor < 0 || ftruncate(descriptor, off_t(segmentSize)) != 0) {
+		std::cout << "Cannot create shared memory " << name << _endl_;
+		exit(1);
+	}
+	segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (segment == MAP_FAILED) {
+		std::cout << "Cannot map shared memory " << name << _endl_;
+		exit(1);
+	}
+	// mapped before workers are forked, so forked workers publish into the same segment
+	auto segmentHeader = new (segment) SegmentHeader;
+	std::copy(std::begin(streamMagic), std::end(streamMagic), segmentHeader->magic);
+	segmentHeader->version = streamVersion;
+	segmentHeader->recordSize = sizeof(OTPCStreamRecord);
+	segmentHeader->ringCount = rings;
+	segmentHeader->capacity = capacity;
+	segmentHeader->consumers = 0;
+	segmentHeader->closed = 0;
+	segmentHeader->heartbeat = 0;
+	for (std::size_t ring = 0; ring < rings; ring++) {
+		auto ringHeader = new (&::ringHeader(segment, ring)) RingHeader;
+		ringHeader->head = 0;
+		ringHeader->tail = 0;
+		ringHeader->dropped = 0;
+	}
+	std::cout << "Streaming events to shared memory " << name << '\n';
+#else
+	std::cout << "Event streaming is only available on Linux" << _endl_;
+	exit(1);
+#endif
+}
+
+OTPCEventStream::~OTPCEventStream() {
+#ifdef __linux__
+	close();
+	munmap(segment, segmentSize);
+	// attached consumers keep their mapping until they detach
+	shm_unlink(name.c_str());
+#endif
+}
+
+OTPCEventStream::Policy OTPCEventStream::parsePolicy(const std::string& policy) {
+	if (policy == "block") {
+		return Policy::block;
+	}
+	if (policy != "drop") {
+		std::cout << "Unknown stream policy " << policy << ", use block or drop" << _endl_;
+		exit(1);
+	}
+	return Policy::drop;
+}
+
+std::size_t OTPCEventStream::getNumberOfRings() const {
+	return header(segment).ringCount;
+}
+
+bool OTPCEventStream::publish(std::size_t ring, const OTPCStreamRecord& record) {
+	auto& segmentHeader = header(segment);
+	auto& ringHeader = ::ringHeader(segment, ring);
+	auto head = ringHeader.head.load(std::memory_order_relaxed);
+	while (head - ringHeader.tail.load(std::memory_order_acquire) >= segmentHeader.capacity) {
+		if (policy == Policy::drop || !isConsumerAlive(segmentHeader)) {
+			ringHeader.dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	ringRecords(segment, ring)[head & (segmentHeader.capacity - 1)] = record;
+	ringHeader.head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+void OTPCEventStream::close() {
+	header(segment).closed.store(1, std::memory_order_release);
+}
+
+OTPCStreamConsumer::OTPCStreamConsumer(const std::string& nameArg) : name(sharedMemoryName(nameArg)) {
+#ifdef __linux__
+	int descriptor = shm_open(name.c_str(), O_RDWR, 0);
+	struct stat status;
+	if (descriptor < 0 || fstat(descriptor, &status) != 0 || std::size_t(status.st_size) < sizeof(SegmentHeader)) {
+		std::cout << "No event stream " << name << " (is the simulation running with --stream?)" << _endl_;
+		exit(1);
+	}
+	segmentSize = status.st_size;
+	segment = mmap(nullptr, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	if (segment == MAP_FAILED) {
+		std::cout << "Cannot map shared memory " << name << _endl_;
+		exit(1);
+	}
+	auto& segmentHeader = header(segment);
+	if (!std::equal(std::begin(streamMagic), std::end(streamMagic), segmentHeader.magic) || segmentHeader.version != streamVersion ||
+		segmentHeader.recordSize != sizeof(OTPCStreamRecord) || segmentSizeFor(segmentHeader.ringCount, segmentHeader.capacity) != segmentSize) {
+		std::cout << "Event stream " << name << " has a different layout" << _endl_;
+		exit(1);
+	}
+	segmentHeader.heartbeat.store(steadyNow(), std::memory_order_relaxed);
+	segmentHeader.consumers.fetch_add(1);
+#else
+	std::cout << "Event streaming is only available on Linux" << _endl_;
+	exit(1);
+#endif
+}
+
+OTPCStreamConsumer::~OTPCStreamConsumer() {
+#ifdef __linux__
+	header(segment).consumers.fetch_sub(1);
+	munmap(segment, segmentSize);
+#endif
+}
+
+std::size_t OTPCStreamConsumer::poll(std::vector<OTPCStreamRecord>& records, std::size_t maxRecords) {
+	auto& segmentHeader = header(segment);
+	segmentHeader.heartbeat.store(steadyNow(), std::memory_order_relaxed);
+	std::size_t polled = 0;
+	for (std::size_t ring = 0; ring < segmentHeader.ringCount && polled < maxRecords; ring++) {
+		auto& ringHeader = ::ringHeader(segment, ring);
+		auto tail = ringHeader.tail.load(std::memory_order_relaxed);
+		auto available = std::min<uint64_t>(ringHeader.head.load(std::memory_order_acquire) - tail, maxRecords - polled);
+		auto ringRecords = ::ringRecords(segment, ring);
+		for (uint64_t i = 0; i < available; i++) {
+			records.push_back(ringRecords[(tail + i) & (segmentHeader.capacity - 1)]);
+		}
+		ringHeader.tail.store(tail + available, std::memory_order_release);
+		polled += available;
+	}
+	return polled;
+}
+
+bool OTPCStreamConsumer::isFinished() const {
+	auto& segmentHeader = header(segment);
+	if (!segmentHeader.closed.load(std::memory_order_acquire)) {
+		return false;
+	}
+	for (std::size_t ring = 0; ring < segmentHeader.ringCount; ring++) {
+		auto& ringHeader = ::ringHeader(segment, ring);
+		if (ringHeader.head.load(std::memory_order_acquire) != ringHeader.tail.load(std::memory_order_relaxed)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+uint64_t OTPCStreamConsumer::getDroppedRecords() const {
+	uint64_t dropped = 0;
+	for (std::size_t ring = 0; ring < header(segment).ringCount; ring++) {
+		dropped += ringHeader(segment, ring).dropped.load(std::memory_order_relaxed);
+	}
+	return dropped;
+}
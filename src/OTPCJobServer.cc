@@ -0,0 +1,287 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Long-lived simulation server accepting jobs over a local UNIX socket
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCJobServer.hh"
+#include "OTPCRunConfiguration.hh"
+#include "OTPCReplay.hh"
+
+#include "G4RunManager.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCJobServer::OTPCJobServer(G4RunManager* runManagerArg, OTPCRunConfiguration& config, std::filesystem::path socketPathArg) :
+	runManager(runManagerArg), runConfiguration(config), socketPath(socketPathArg) {}
+
+#ifdef __linux__
+
+OTPCJobServer::ClientConnection::~ClientConnection() {
+	close(socket);
+}
+
+void OTPCJobServer::ClientConnection::send(const std::string& message) {
+	std::lock_guard lock(sendMutex);
+	auto line = message + '\n';
+	// client may have disconnected already, the job still runs
+	::send(socket, line.data(), line.size(), MSG_NOSIGNAL);
+}
+
+OTPCJobServer::~OTPCJobServer() {
+	if (serverSocket >= 0) {
+		shutdown(serverSocket, SHUT_RDWR);
+		close(serverSocket);
+	}
+	if (listener.joinable()) {
+		listener.join();
+	}
+	{
+		std::lock_guard lock(queueMutex);
+		for (auto& reader : readers) {
+			if (auto connection = reader.client.lock()) {
+				shutdown(connection->socket, SHUT_RDWR); // unblocks the reader thread
+			}
+		}
+	}
+	for (auto& reader : readers) {
+		reader.thread.join();
+	}
+	std::filesystem::remove(socketPath);
+}
+
+int OTPCJobServer::run() {
+	serverSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	if (serverSocket < 0 || socketPath.string().size() >= sizeof(address.sun_path)) {
+		std::cout << "Cannot create server socket" << _endl_;
+		return 1;
+	}
+	socketPath.string().copy(address.sun_path, sizeof(address.sun_path) - 1);
+	std::filesystem::remove(socketPath);
+	if (bind(serverSocket, (sockaddr*)&address, sizeof(address)) < 0 || listen(serverSocket, 16) < 0) {
+		std::cout << "Cannot listen on " << socketPath << _endl_;
+		return 1;
+	}
+	std::cout << "Serving jobs on " << socketPath << '\n';
+	listener = std::thread(&OTPCJobServer::acceptConnections, this);
+
+	// jobs are run on this thread, the Geant4 kernel is not thread-safe across BeamOn calls
+	while (true) {
+		Job job;
+		{
+			std::unique_lock lock(queueMutex);
+			queueCondition.wait(lock, [&] { return stopRequested || !jobQueue.empty(); });
+			if (stopRequested) {
+				for (auto& cancelledJob : jobQueue) {
+					cancelledJob.client->send(std::format("failed {} cancelled", cancelledJob.id));
+				}
+				jobQueue.clear();
+				break;
+			}
+			job = std::move(jobQueue.front());
+			jobQueue.pop_front();
+		}
+		runJob(job);
+	}
+	return 0;
+}
+
+void OTPCJobServer::acceptConnections() {
+	while (true) {
+		int clientSocket = accept(serverSocket, nullptr, nullptr);
+		if (clientSocket < 0) {
+			return; // server socket shut down
+		}
+		auto client = std::make_shared<ClientConnection>(clientSocket);
+		auto finished = std::make_shared<std::atomic<bool>>(false);
+		std::lock_guard lock(queueMutex);
+		// readers of disconnected clients are joined here, a long-running server does not keep them all
+		std::erase_if(readers, [](Reader& reader) {
+			if (!*reader.finished) {
+				return false;
+			}
+			reader.thread.join();
+			return true;
+		});
+		readers.push_back({ std::thread([this, client, finished] {
+			readJobs(client);
+			*finished = true;
+		}), finished, client });
+	}
+}
+
+void OTPCJobServer::readJobs(std::shared_ptr<ClientConnection> client) {
+	std::string buffer;
+	char chunk[4096];
+	while (true) {
+		auto received = recv(client->socket, chunk, sizeof(chunk), 0);
+		if (received <= 0) {
+			return;
+		}
+		buffer.append(chunk, received);
+		for (auto newline = buffer.find('\n'); newline != std::string::npos; newline = buffer.find('\n')) {
+			auto line = buffer.substr(0, newline);
+			buffer.erase(0, newline + 1);
+			if (line.empty()) {
+				continue;
+			}
+			if (line == "shutdown") {
+				std::lock_guard lock(queueMutex);
+				stopRequested = true;
+				queueCondition.notify_one();
+				return;
+			}
+			Job job;
+			std::string error;
+			if (!parseJob(line, job, error)) {
+				client->send("error " + error);
+				continue;
+			}
+			job.client = client;
+			std::lock_guard lock(queueMutex);
+			job.id = jobCounter++;
+			client->send(std::format("queued {}", job.id));
+			jobQueue.push_back(std::move(job));
+			queueCondition.notify_one();
+		}
+	}
+}
+
+bool OTPCJobServer::parseJob(const std::string& line, Job& job, std::string& error) {
+	job.energy = -1;
+	job.events = 0;
+	job.firstEvent = UINT64_MAX;
+	job.position = { 0, 0, 0 };
+	std::istringstream tokens(line);
+	std::string token;
+	try {
+		while (tokens >> token) {
+			auto separator = token.find('=');
+			if (separator == std::string::npos) {
+				error = "expected key=value, got " + token;
+				return false;
+			}
+			auto key = token.substr(0, separator);
+			auto value = token.substr(separator + 1);
+			if (key == "energy") {
+				job.energy = std::stod(value) * keV;
+			}
+			else if (key == "events") {
+				job.events = std::stoull(value);
+			}
+			else if (key == "first_event") {
+				job.firstEvent = std::stoull(value);
+			}
+			else if (key == "output") {
+				job.outputPath = value;
+			}
+			else if (key == "position") {
+				G4double x, y, z;
+				char comma1, comma2;
+				std::istringstream coordinates(value);
+				if (!(coordinates >> x >> comma1 >> y >> comma2 >> z) || comma1 != ',' || comma2 != ',') {
+					error = "position must be x,y,z in mm";
+					return false;
+				}
+				job.position = { x * mm, y * mm, z * mm };
+			}
+			else {
+				error = "unknown key " + key;
+				return false;
+			}
+		}
+	}
+	catch (const std::exception&) {
+		error = "invalid number in " + token;
+		return false;
+	}
+	if (job.energy <= 0 || job.events == 0 || job.outputPath.empty()) {
+		error = "energy, events and output are required";
+		return false;
+	}
+	if (job.events > uint64_t(std::numeric_limits<G4int>::max())) {
+		error = "too many events in one job";
+		return false;
+	}
+	return true;
+}
+
+void OTPCJobServer::runJob(const Job& job) {
+	job.client->send(std::format("started {}", job.id));
+	auto start = std::chrono::high_resolution_clock::now();
+
+	std::error_code errorCode;
+	std::filesystem::create_directories(job.outputPath, errorCode);
+	if (errorCode) {
+		job.client->send(std::format("failed {} {}", job.id, errorCode.message()));
+		return;
+	}
+	auto partialFileName = std::format("event_{}keV_", job.energy / keV);
+	runConfiguration.setEnergy(job.energy);
+	runConfiguration.setPosition(job.position);
+	runConfiguration.setRunPath(job.outputPath);
+	runConfiguration.setEventFilePath(job.outputPath / (partialFileName + "totalDeposit"), job.outputPath / (partialFileName + "stepsDeposit"));
+	// jobs of one energy get distinct events, repeating the numbers would repeat the random streams
+	auto& nextEvent = nextEvents[job.energy];
+	auto firstEvent = job.firstEvent == UINT64_MAX ? nextEvent : job.firstEvent;
+	nextEvent = std::max(nextEvent, firstEvent + job.events);
+	std::ofstream jobsFile(job.outputPath / "jobs.txt", std::ios_base::app);
+	jobsFile << std::format("job {} energy {} first_event {} events {} seed {}\n", job.id, job.energy / keV, firstEvent, job.events, runConfiguration.getRunSeed());
+	if (!jobsFile) {
+		job.client->send(std::format("failed {} cannot write jobs.txt", job.id));
+		return;
+	}
+	jobsFile.close();
+	OTPCReplay(job.outputPath).saveRunSeed(runConfiguration.getRunSeed());
+	runConfiguration.setEventNumbering(firstEvent, firstEvent + job.events);
+	runManager->BeamOn(G4int(job.events));
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	job.client->send(std::format("done {} {} {}", job.id, job.events, std::chrono::duration<double>(stop - start).count()));
+}
+
+#else
+
+OTPCJobServer::ClientConnection::~ClientConnection() {}
+
+void OTPCJobServer::ClientConnection::send(const std::string&) {}
+
+OTPCJobServer::~OTPCJobServer() {}
+
+int OTPCJobServer::run() {
+	std::cout << "Job server is only available on Linux" << _endl_;
+	return 1;
+}
+
+void OTPCJobServer::acceptConnections() {}
+
+void OTPCJobServer::readJobs(std::shared_ptr<ClientConnection>) {}
+
+bool OTPCJobServer::parseJob(const std::string&, Job&, std::string&) {
+	return false;
+}
+
+void OTPCJobServer::runJob(const Job&) {}
+
+#endif
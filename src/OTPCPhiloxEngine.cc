@@ -0,0 +1,162 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Counter-based Philox4x32-10 random engine
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCPhiloxEngine.hh"
+
+#include <fstream>
+#include <iostream>
+#include <bit>
+#include <random>
+#include <chrono>
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+namespace {
+	const uint32_t
+		philoxM0 = 0xD2511F53,
+		philoxM1 = 0xCD9E8D57,
+		philoxW0 = 0x9E3779B9,
+		philoxW1 = 0xBB67AE85;
+
+	uint64_t splitmix64(uint64_t x) {
+		x += 0x9E3779B97F4A7C15ull;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	}
+}
+
+OTPCPhiloxEngine::OTPCPhiloxEngine(uint64_t seed) {
+	setKey(seed);
+	counter = { 0, 0, 0, 0 };
+	outputIndex = 2;
+}
+
+OTPCPhiloxEngine::Block OTPCPhiloxEngine::philox(Block ctr, std::array<uint32_t, 2> k) {
+	for (int round = 0; round < 10; round++) {
+		uint64_t product0 = uint64_t(philoxM0) * ctr[0];
+		uint64_t product1 = uint64_t(philoxM1) * ctr[2];
+		ctr = {
+			uint32_t(product1 >> 32) ^ ctr[1] ^ k[0],
+			uint32_t(product1),
+			uint32_t(product0 >> 32) ^ ctr[3] ^ k[1],
+			uint32_t(product0) };
+		k[0] += philoxW0;
+		k[1] += philoxW1;
+	}
+	return ctr;
+}
+
+void OTPCPhiloxEngine::setKey(uint64_t k) {
+	key = { uint32_t(k), uint32_t(k >> 32) };
+}
+
+void OTPCPhiloxEngine::setStream(uint64_t runSeed, G4double energy, uint64_t eventNumber) {
+	// energy enters by value, so a stream does not depend on how the energies were scheduled;
+	// the combination is hashed again, a seed with structure cannot cancel the energy term
+	setKey(splitmix64(runSeed ^ splitmix64(std::bit_cast<uint64_t>(energy))));
+	counter = { 0, uint32_t(eventNumber), uint32_t(eventNumber >> 32), 0 };
+	outputIndex = 2;
+}
+
+uint64_t OTPCPhiloxEngine::makeRunSeed() {
+	// time alone repeats for jobs started in the same second, which would then share all their streams
+	std::random_device randomDevice;
+	uint64_t entropy = (uint64_t(randomDevice()) << 32) ^ randomDevice();
+	entropy ^= splitmix64(uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()));
+#ifdef __linux__
+	entropy ^= splitmix64(uint64_t(getpid()) << 32);
+#endif
+	// positive, the seed is also passed around as a signed integer
+	return splitmix64(entropy) >> 1;
+}
+
+double OTPCPhiloxEngine::flat() {
+	if (outputIndex == 2) {
+		output = philox(counter, key);
+		counter[0]++;
+		outputIndex = 0;
+	}
+	uint64_t bits = (uint64_t(output[2 * outputIndex]) << 32) | output[2 * outputIndex + 1];
+	outputIndex++;
+	// 53 random bits, shifted by half a step so that 0 and 1 are never returned
+	return ((bits >> 11) + 0.5) * 0x1.0p-53;
+}
+
+void OTPCPhiloxEngine::flatArray(const int size, double* vect) {
+	for (int i = 0; i < size; i++) {
+		vect[i] = flat();
+	}
+}
+
+void OTPCPhiloxEngine::setSeed(long seed, int) {
+	setKey(uint64_t(seed));
+	counter = { 0, 0, 0, 0 };
+	outputIndex = 2;
+}
+
+void OTPCPhiloxEngine::setSeeds(const long* seeds, int) {
+	// seeds set by the run manager before every event are superseded by setStream in GeneratePrimaries
+	// the seed list is zero terminated
+	uint64_t k = uint64_t(seeds[0]);
+	if (seeds[0] != 0) {
+		k = (k << 32) ^ uint64_t(seeds[1]);
+	}
+	setKey(k);
+	counter = { 0, 0, 0, 0 };
+	outputIndex = 2;
+}
+
+void OTPCPhiloxEngine::saveStatus(const char filename[]) const {
+	std::ofstream outFile(filename, std::ios_base::out | std::ios_base::trunc);
+	put(outFile);
+}
+
+void OTPCPhiloxEngine::restoreStatus(const char filename[]) {
+	std::ifstream inFile(filename);
+	if (inFile.is_open()) {
+		get(inFile);
+	}
+}
+
+void OTPCPhiloxEngine::showStatus() const {
+	std::cout << "----- Philox4x32-10 engine status -----\n";
+	put(std::cout);
+	std::cout << "---------------------------------------\n";
+}
+
+std::string OTPCPhiloxEngine::name() const {
+	return "OTPCPhiloxEngine";
+}
+
+std::ostream& OTPCPhiloxEngine::put(std::ostream& os) const {
+	os << name() << '\n' << key[0] << ' ' << key[1];
+	for (auto c : counter) {
+		os << ' ' << c;
+	}
+	return os << ' ' << outputIndex << '\n';
+}
+
+std::istream& OTPCPhiloxEngine::get(std::istream& is) {
+	std::string engineName;
+	is >> engineName;
+	if (engineName != name()) {
+		is.clear(std::ios::badbit | is.rdstate());
+		return is;
+	}
+	is >> key[0] >> key[1] >> counter[0] >> counter[1] >> counter[2] >> counter[3] >> outputIndex;
+	if (outputIndex < 2 && counter[0] > 0) { // output of the current block is regenerated
+		auto current = counter;
+		current[0]--;
+		output = philox(current, key);
+	}
+	else {
+		outputIndex = 2;
+	}
+	return is;
+}
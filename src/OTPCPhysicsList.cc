@@ -145,6 +145,12 @@ void OTPCPhysicsList::ConstructProcess()
 	//  
 	AddStepMax();
 
+	// local deposition of electrons that cannot leave their volume
+	//
+	if (rangeCut) {
+		AddRangeCut();
+	}
+
 	// Ion Gas models
 	//AddIonGasModels();
 
@@ -276,6 +282,34 @@ void OTPCPhysicsList::AddStepMax()
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+#include "OTPCRangeCut.hh"
+
+void OTPCPhysicsList::setRangeCut(G4bool enabled, G4double tolerance)
+{
+	rangeCut = enabled;
+	rangeCutTolerance = tolerance;
+}
+
+void OTPCPhysicsList::AddRangeCut()
+{
+	// one process per thread like the step limitation
+	OTPCRangeCut* rangeCutProcess = new OTPCRangeCut(rangeCutTolerance);
+
+	auto particleIterator = GetParticleIterator();
+	particleIterator->reset();
+	while ((*particleIterator)()) {
+		G4ParticleDefinition* particle = particleIterator->value();
+		G4ProcessManager* pmanager = particle->GetProcessManager();
+
+		if (rangeCutProcess->IsApplicable(*particle))
+		{
+			pmanager->AddDiscreteProcess(rangeCutProcess);
+		}
+	}
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 //////////////////////////////////////////////////////////////////
 /// Adds the ion gas model
 
@@ -21,10 +21,13 @@
 #include "fstream"
 #include "iomanip"
 #include <cstdlib>
-#include <random>
+#include <algorithm>
+#include <numeric>
 
 
 #include "OTPCRunAction.hh"
+#include "OTPCRunConfiguration.hh"
+#include "OTPCPhiloxEngine.hh"
 
 inline std::string filename_string(std::string path_str) {
 	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
@@ -38,13 +41,20 @@ G4double generateRandomEnergy() {
 	static const std::array<G4double, 5> energies = { 204.0 * keV, 275.0 * keV, 583.0 * keV, 595.0 * keV, 866.0 * keV };
 	static const std::array<G4double, 5> probabilities = { 0.030943, 0.141454, 0.168222, 0.168222, 0.491159 };
 
-	// Set up the discrete distribution
-	static const std::discrete_distribution<int> distribution(probabilities.begin(), probabilities.end());
+	// Cumulative distribution is built once and only read afterwards, so it is safe to share between threads
+	static const std::array<G4double, 5> cumulative = [] {
+		std::array<G4double, 5> c;
+		std::partial_sum(probabilities.begin(), probabilities.end(), c.begin());
+		for (auto& c_i : c) {
+			c_i /= c.back();
+		}
+		return c;
+	}();
 
-	// Generate a random index based on the probabilities
-	static std::random_device rd;
-	static std::mt19937 generator(rd());
-	int index = distribution(generator);
+	// Generate a random index based on the probabilities using the thread-local Geant4 engine
+	auto index = std::min<std::size_t>(
+		std::upper_bound(cumulative.begin(), cumulative.end(), G4UniformRand()) - cumulative.begin(),
+		energies.size() - 1);
 
 	// Return the energy corresponding to the generated index
 	return energies[index];
@@ -70,15 +80,13 @@ G4ThreeVector generateRandomPosition() {
 }
 
 
-OTPCPrimaryGeneratorAction::OTPCPrimaryGeneratorAction(OTPCRunAction* RunAct, bool loadDataFromFileArg)
-	:runAction(RunAct), loadDataFromFile(loadDataFromFileArg)
+OTPCPrimaryGeneratorAction::OTPCPrimaryGeneratorAction(OTPCRunAction* RunAct, const OTPCRunConfiguration& config)
+	:runAction(RunAct), runConfiguration(config), loadDataFromFile(config.isDataLoadedFromFile())
 {
 
-	//choose the Random engine 
-	CLHEP::HepRandom::setTheEngine(new CLHEP::RanecuEngine());
-	//set random seed with system time (it must change from one run to another!!! otherwise we simulate all the time the same in the OTPC case!!)
-	G4long seed = time(NULL);
-	CLHEP::HepRandom::setTheSeed(seed);
+	// every event draws from its own counter-based stream, selected in GeneratePrimaries;
+	// the engine is handed over to CLHEP on this thread and therefore never deleted
+	randomEngine = new OTPCPhiloxEngine(runConfiguration.getRunSeed());
 
 	// //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	/*
@@ -128,10 +136,6 @@ OTPCPrimaryGeneratorAction::OTPCPrimaryGeneratorAction(OTPCRunAction* RunAct, bo
 
 	particleDefinitions = { proton,alpha,ion,gammaray, geantino };
 
-	if (loadDataFromFile) {
-		loadData();
-	}
-
 }
 
 
@@ -156,6 +160,23 @@ void OTPCPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 	/// //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	//Simulation of physical particles
 
+	// source settings are copied per event as they can be changed by main() between runs
+	for (int i = 0; i < 3; i++) {
+		E[i] = runConfiguration.getEnergy(i);
+	}
+	if (runConfiguration.isEnergySweep()) {
+		E[0] = runConfiguration.getEnergyPoint(runConfiguration.getEnergyIndex(anEvent->GetEventID())).energy;
+	}
+	position = runConfiguration.getPosition();
+
+	// the stream depends only on (run seed, energy, event number), so any event can be regenerated
+	// on its own regardless of thread, forked process or slice it was originally simulated in;
+	// this overrides the per-event seeds the run manager hands to worker threads
+	if (G4Random::getTheEngine() != randomEngine) {
+		G4Random::setTheEngine(randomEngine);
+	}
+	randomEngine->setStream(runConfiguration.getRunSeed(), E[0], runConfiguration.getGlobalEventNumber(anEvent->GetEventID()));
+
 	// initial position is randomized if data is loaded from file
 	if (loadDataFromFile) {
 		position = generateRandomPosition();
@@ -172,18 +193,19 @@ void OTPCPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 		E[1] = generateRandomEnergy();
 	}
 
-	std::array tpl = { E[0] / keV, E[1] / keV, E[2] / keV, position.x() / mm, position.y() / mm, position.z() / mm, theta[0] / degree, theta[1] / degree, theta[3] / degree, phi[0] / degree, phi[1] / degree, phi[2] / degree };
-	metaFile.write((char*)tpl.data(), sizeof(tpl));
+	// written out together with the deposits of this event by OTPCRunAction
+	primaryInfo = { E[0] / keV, E[1] / keV, E[2] / keV, position.x() / mm, position.y() / mm, position.z() / mm, theta[0] / degree, theta[1] / degree, theta[2] / degree, phi[0] / degree, phi[1] / degree, phi[2] / degree };
 
 	for (G4int i = 0; i < 3; i++) {
-		if (loadDataFromFile && type[i] == 4 && E[1] != 595.0 * keV) {
+		G4int type = runConfiguration.getParticleType(i);
+		if (loadDataFromFile && type == 4 && E[1] != 595.0 * keV) {
 			continue;
 		}
-		if (type[i] > 0 && type[i] < 6) {
+		if (type > 0 && type < 6) {
 			//Momentum direction according to input angles
 			G4ThreeVector momentumDirection;
 			momentumDirection.setRThetaPhi(1., theta[i], phi[i]);
-			particleGun->SetParticleDefinition(particleDefinitions[type[i] - 1]);
+			particleGun->SetParticleDefinition(particleDefinitions[type - 1]);
 
 			particleGun->SetParticlePosition(position);
 			particleGun->SetParticleMomentumDirection(momentumDirection);
@@ -195,44 +217,12 @@ void OTPCPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 	}
 }
 
-void OTPCPrimaryGeneratorAction::setRunPath(std::filesystem::path runPath) {
-	metaFile.open(runPath / "metadata.bin", std::ios_base::binary | std::ios_base::out);
-}
+const std::array<std::string, 12> OTPCPrimaryGeneratorAction::primaryInfoNames = {
+	"energy0_keV", "energy1_keV", "energy2_keV",
+	"x_mm", "y_mm", "z_mm",
+	"theta0_deg", "theta1_deg", "theta2_deg",
+	"phi0_deg", "phi1_deg", "phi2_deg" };
 
-G4double OTPCPrimaryGeneratorAction::getEnergy(int index) const {
-	return E[index];
+const std::array<G4double, 12>& OTPCPrimaryGeneratorAction::getPrimaryInfo() const {
+	return primaryInfo;
 }
-
-void OTPCPrimaryGeneratorAction::setEnergy(G4double energy, int index) {
-	E[index] = energy;
-}
-
-void OTPCPrimaryGeneratorAction::setPosition(G4ThreeVector pos) {
-	position = pos;
-}
-
-void OTPCPrimaryGeneratorAction::loadData() {
-	//////////////////////////////////////////////////////////////////////////////
-
-	//////////Reading the input data for primary generator///////////
-
-	std::ifstream evenInputInformation;
-	evenInputInformation.open("../../../particles3.data");
-	if (!evenInputInformation.is_open()) {
-		std::cout << "\n\nNO EVENT INPUT INFORMATION FILE FOUND!!!" << _endl_;
-		exit(1);
-	}
-	std::string header1, header2;
-
-	evenInputInformation >> header1;
-	evenInputInformation >> type[0] >> type[1] >> type[2];
-	evenInputInformation >> header2;
-	evenInputInformation >> E[0] >> E[1] >> E[2];
-	evenInputInformation.close();
-	for (auto& energy : E) {
-		energy *= keV;
-	}
-	G4cout << E[0] / keV << " " << E[1] / keV << " " << E[2] / keV << '\n';
-}
-
-
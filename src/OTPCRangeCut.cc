@@ -0,0 +1,47 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Local deposition of electrons that cannot leave their volume
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCRangeCut.hh"
+
+#include "G4Electron.hh"
+#include "G4Track.hh"
+#include "G4Step.hh"
+#include "G4LossTableManager.hh"
+#include "G4TransportationManager.hh"
+#include "G4Navigator.hh"
+
+OTPCRangeCut::OTPCRangeCut(G4double toleranceArg, const G4String& processName) :
+	G4VDiscreteProcess(processName, fUserDefined),
+	tolerance(toleranceArg),
+	lossTableManager(G4LossTableManager::Instance()) {}
+
+G4bool OTPCRangeCut::IsApplicable(const G4ParticleDefinition& particle) {
+	// positrons would lose their annihilation photons
+	return &particle == G4Electron::Electron();
+}
+
+G4double OTPCRangeCut::PostStepGetPhysicalInteractionLength(const G4Track& track, G4double, G4ForceCondition* condition) {
+	*condition = NotForced;
+	// tables are built with SetBuildCSDARange, the range is DBL_MAX otherwise and nothing is cut
+	G4double range = lossTableManager->GetCSDARange(track.GetDefinition(), track.GetKineticEnergy(), track.GetMaterialCutsCouple());
+	if (range <= tolerance) {
+		return 0;
+	}
+	// transportation computed the safety at the end of the previous step, new tracks have none yet
+	G4double safety = track.GetStep()->GetPreStepPoint()->GetSafety();
+	if (safety <= 0 && track.GetCurrentStepNumber() <= 1) {
+		safety = G4TransportationManager::GetTransportationManager()->GetNavigatorForTracking()->ComputeSafety(track.GetPosition(), range);
+	}
+	return range < safety ? 0 : DBL_MAX;
+}
+
+G4VParticleChange* OTPCRangeCut::PostStepDoIt(const G4Track& track, const G4Step&) {
+	aParticleChange.Initialize(track);
+	aParticleChange.ProposeLocalEnergyDeposit(track.GetKineticEnergy());
+	aParticleChange.ProposeEnergy(0);
+	aParticleChange.ProposeTrackStatus(fStopAndKill);
+	return &aParticleChange;
+}
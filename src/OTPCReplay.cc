@@ -0,0 +1,118 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Deferred replay of selected events with full step detail
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCReplay.hh"
+#include "OTPCContainer.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <format>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCReplay::OTPCReplay(std::filesystem::path runDirectoryPathArg) :
+	runDirectoryPath(runDirectoryPathArg),
+	seedPath(runDirectoryPath / "replay.txt") {}
+
+void OTPCReplay::saveRunSeed(uint64_t runSeed) const {
+	std::ofstream seedFile(seedPath, std::ios_base::out | std::ios_base::trunc);
+	seedFile << std::format("seed {}\n", runSeed);
+	if (!seedFile) {
+		std::cout << "Cannot write " << seedPath << _endl_;
+		exit(1);
+	}
+}
+
+bool OTPCReplay::hasRunSeed() const {
+	return std::filesystem::exists(seedPath);
+}
+
+uint64_t OTPCReplay::loadRunSeed() const {
+	std::ifstream seedFile(seedPath);
+	std::string key;
+	uint64_t runSeed;
+	if (!(seedFile >> key >> runSeed) || key != "seed") {
+		std::cout << "No run seed in " << seedPath << ", the run cannot be replayed" << _endl_;
+		exit(1);
+	}
+	return runSeed;
+}
+
+void OTPCReplay::loadSelection(const std::filesystem::path& selectionPath) {
+	std::ifstream selectionFile(selectionPath);
+	if (!selectionFile.is_open()) {
+		std::cout << "Cannot open replay selection " << selectionPath << _endl_;
+		exit(1);
+	}
+	std::string line;
+	while (std::getline(selectionFile, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream lineStream(line);
+		double energy;
+		uint64_t eventNumber;
+		if (lineStream >> energy >> eventNumber) {
+			selection[energy].push_back(eventNumber);
+		}
+	}
+	sortSelection();
+}
+
+void OTPCReplay::selectAccepted() {
+	// the container of the production pass is next to replay.txt
+	OTPCContainerReader container(runDirectoryPath / "events.otpc");
+	auto& schema = container.getSchema();
+	auto hasColumn = [&](const std::string& name) {
+		return std::any_of(schema.begin(), schema.end(), [&](const OTPCColumn& column) { return column.name == name; });
+	};
+	if (!hasColumn("event") || !hasColumn("trigger")) {
+		std::cout << "Run was written without trigger, select the events to replay in a file" << _endl_;
+		exit(1);
+	}
+	auto eventColumn = container.getColumnIndex("event");
+	auto triggerColumn = container.getColumnIndex("trigger");
+	for (auto energy : container.getEnergies()) {
+		uint64_t lastEvent = 0;
+		for (const auto& chunk : container.getChunks()) {
+			if (chunk.column == eventColumn && chunk.energy == energy) {
+				lastEvent = std::max(lastEvent, chunk.lastEvent);
+			}
+		}
+		// both columns hold the written events in the same order
+		auto events = container.readEvents(eventColumn, energy, 0, lastEvent + 1);
+		auto triggers = container.readEvents(triggerColumn, energy, 0, lastEvent + 1);
+		for (std::size_t i = 0; i < triggers.size(); i++) {
+			if (triggers[i] == 0) {
+				uint64_t eventNumber;
+				std::memcpy(&eventNumber, events.data() + i * sizeof(eventNumber), sizeof(eventNumber));
+				selection[energy].push_back(eventNumber);
+			}
+		}
+	}
+	sortSelection();
+}
+
+void OTPCReplay::sortSelection() {
+	// workers of a run process their events in increasing order, which the shard merge relies on
+	for (auto& [energy, events] : selection) {
+		std::sort(events.begin(), events.end());
+		events.erase(std::unique(events.begin(), events.end()), events.end());
+	}
+}
+
+const std::map<double, std::vector<uint64_t>>& OTPCReplay::getSelection() const {
+	return selection;
+}
+
+std::filesystem::path OTPCReplay::getReplayPath() const {
+	return runDirectoryPath / "replay";
+}
@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Content-addressed store of simulation results
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCResultCache.hh"
+
+#include "G4Material.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <format>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	// FNV-1a, stable across compilers and platforms unlike std::hash
+	uint64_t fnv1a(const std::string& text, uint64_t basis) {
+		uint64_t hash = basis;
+		for (unsigned char c : text) {
+			hash ^= c;
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+}
+
+OTPCResultCache::OTPCResultCache(std::filesystem::path storePathArg) : storePath(storePathArg) {}
+
+OTPCResultCache::~OTPCResultCache() {
+#ifdef __linux__
+	if (lockDescriptor >= 0) {
+		::close(lockDescriptor);
+	}
+#endif
+}
+
+void OTPCResultCache::add(const std::string& key, const std::string& value) {
+	inputs.emplace_back(key, value);
+}
+
+void OTPCResultCache::addFile(const std::string& key, const std::filesystem::path& filePath) {
+	std::ifstream inputFile(filePath, std::ios_base::in | std::ios_base::binary);
+	if (!inputFile.is_open()) {
+		add(key, "missing " + filePath.string());
+		return;
+	}
+	std::ostringstream content;
+	content << inputFile.rdbuf();
+	// line endings of a file copied between systems do not change the configuration
+	auto text = content.str();
+	std::erase(text, '\r');
+	add(key, text);
+}
+
+void OTPCResultCache::addMaterials() {
+	for (const auto material : *G4Material::GetMaterialTable()) {
+		auto description = std::format("{} {} g/cm3 {} K {} atm state {}",
+			material->GetName(),
+			material->GetDensity() / (g / cm3),
+			material->GetTemperature() / kelvin,
+			material->GetPressure() / atmosphere,
+			int(material->GetState()));
+		auto fractions = material->GetFractionVector();
+		for (std::size_t element = 0; element < material->GetNumberOfElements(); element++) {
+			description += std::format(" {} {}", material->GetElement(element)->GetName(), fractions[element]);
+		}
+		add("material", description);
+	}
+}
+
+std::string OTPCResultCache::getDescription() const {
+	std::string description;
+	for (const auto& [key, value] : inputs) {
+		// multi-line values (file contents) get the key on every line
+		std::istringstream valueStream(value);
+		std::string line;
+		bool empty = true;
+		while (std::getline(valueStream, line)) {
+			description += std::format("{} = {}\n", key, line);
+			empty = false;
+		}
+		if (empty) {
+			description += key + " =\n";
+		}
+	}
+	return description;
+}
+
+std::string OTPCResultCache::getHash() const {
+	auto description = getDescription();
+	return std::format("{:016x}{:016x}", fnv1a(description, 0xCBF29CE484222325ull), fnv1a(description, 0x84222325CBF29CE4ull));
+}
+
+std::filesystem::path OTPCResultCache::open() {
+	auto description = getDescription();
+	auto configurationPath = storePath / getHash();
+	std::filesystem::create_directories(configurationPath);
+#ifdef __linux__
+	// released by the system also when the job is killed, the next job continues the configuration
+	lockDescriptor = ::open((configurationPath / "lock").c_str(), O_CREAT | O_RDWR, 0644);
+	if (lockDescriptor < 0 || flock(lockDescriptor, LOCK_EX | LOCK_NB) != 0) {
+		std::cout << "Configuration " << configurationPath << " is being simulated by another job" << _endl_;
+		exit(1);
+	}
+#endif
+	auto descriptionPath = configurationPath / "configuration.txt";
+	if (std::filesystem::exists(descriptionPath)) {
+		std::ifstream descriptionFile(descriptionPath, std::ios_base::in | std::ios_base::binary);
+		std::ostringstream storedDescription;
+		storedDescription << descriptionFile.rdbuf();
+		if (storedDescription.str() != description) {
+			std::cout << "Stored configuration " << descriptionPath << " differs from this job" << _endl_;
+			exit(1);
+		}
+		std::cout << "Using stored results " << configurationPath << '\n';
+		return configurationPath;
+	}
+	// written aside and renamed, a description in the store is always complete
+	auto temporaryPath = descriptionPath;
+	temporaryPath += ".tmp";
+	{
+		std::ofstream descriptionFile(temporaryPath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		descriptionFile << description;
+		if (!descriptionFile) {
+			std::cout << "Cannot write " << temporaryPath << _endl_;
+			exit(1);
+		}
+	}
+	std::filesystem::rename(temporaryPath, descriptionPath);
+	std::cout << "New stored configuration " << configurationPath << '\n';
+	return configurationPath;
+}
@@ -15,8 +15,11 @@
 
 #include "OTPCRunAction.hh"
 #include "OTPCPrimaryGeneratorAction.hh"
+#include "OTPCRunConfiguration.hh"
 
 #include "G4Run.hh"
+#include "G4AccumulableManager.hh"
+#include "G4Threading.hh"
 
 #include "G4ios.hh"
 #include "fstream"
@@ -25,7 +28,8 @@
 #include "time.h"
 #include <numeric>
 #include <format>
-#include <execution>
+#include <algorithm>
+#include <iterator>
 
 
 #include "G4SystemOfUnits.hh"
@@ -34,56 +38,261 @@
 
 using namespace std;
 
+std::atomic<uint64_t> OTPCRunAction::eventIndex = 0;
+std::unique_ptr<OTPCStepTraceWriter> OTPCRunAction::stepTrace;
 
-OTPCRunAction::OTPCRunAction()
+namespace {
+	// memory for buffered output of one thread, shared by all its files
+	const std::size_t
+		eventWriterBufferSize = 1 << 23,
+		minimalBlockSize = 1 << 16,
+		maximalBlockSize = 1 << 20;
+
+	// text tables appended run by run, the header is written with the first lines
+	void appendTable(const std::filesystem::path& tablePath, const std::string& header, const std::string& lines) {
+		bool newTable = !std::filesystem::exists(tablePath);
+		std::ofstream tableFile(tablePath, std::ios_base::out | std::ios_base::app);
+		if (newTable) {
+			tableFile << header;
+		}
+		tableFile << lines;
+		tableFile.close();
+		if (!tableFile) {
+			std::cout << "Cannot write " << tablePath << '\n';
+			exit(1);
+		}
+	}
+
+	// forked workers write their lines without header to their own shards, the parent appends them
+	void mergeTableShards(const std::filesystem::path& tablePath, const std::string& header) {
+		auto shards = findShards(tablePath);
+		if (shards.empty()) {
+			return;
+		}
+		std::string lines;
+		for (const auto& shard : shards) {
+			std::ifstream shardFile(shard);
+			lines.append(std::istreambuf_iterator<char>(shardFile), std::istreambuf_iterator<char>());
+		}
+		appendTable(tablePath, header, lines);
+		for (const auto& shard : shards) {
+			std::filesystem::remove(shard);
+		}
+	}
+
+	const std::string stackingSummaryHeader = "rule\taction particles volume min_keV max_keV\ttracks\tenergy_keV\n";
+
+	std::string triggerSummaryHeader() {
+		std::string header = "energy_keV\tprocessed\taccepted\tprescaled";
+		for (const auto& conditionName : OTPCTrigger::conditionNames) {
+			header += "\tfailed_" + conditionName;
+		}
+		return header + '\n';
+	}
+}
+
+OTPCRunAction::OTPCRunAction(const OTPCRunConfiguration& config) :
+	runConfiguration(config),
+	eventFlagCounter("eventFlagCounter", 0),
+	decayCounter("decayCounter", 0),
+	triggerCounters("triggerCounters"),
+	stackingCounters("stackingCounters"),
+	runSummary("runSummary")
 {
 	timer = std::make_unique<G4Timer>();
 
 	runManager = G4RunManager::GetRunManager();
 
+	auto accumulableManager = G4AccumulableManager::Instance();
+	accumulableManager->RegisterAccumulable(eventFlagCounter);
+	accumulableManager->RegisterAccumulable(decayCounter);
+	accumulableManager->RegisterAccumulable(&triggerCounters);
+	accumulableManager->RegisterAccumulable(&stackingCounters);
+	accumulableManager->RegisterAccumulable(&runSummary);
+
 	///////////////////////////////////////////////////////////////////////////////////	
 
 }
 
 void OTPCRunAction::BeginOfRunAction(const G4Run*)
 {
-	//eventTotalDepositFile.open(eventTotalDepositFilePath.string() + ".csv", std::ios_base::out | std::ios_base::trunc);
-	//eventStepsDepositFile.open(eventStepsDepositFilePath.string() + ".csv", std::ios_base::out | std::ios_base::trunc);
-	eventTotalDepositFileBinary.open(eventTotalDepositFilePath.string() + ".bin", std::ios_base::out | std::ios_base::binary | std::ios_base::app);
-	eventTotalGasDepositFileBinary.open(eventTotalDepositFilePath.string() + "_gas.bin", std::ios_base::out | std::ios_base::binary | std::ios_base::app);
-	//eventStepsDepositFileBinary.open(eventStepsDepositFilePath.string() + ".bin", std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
-	currentEnergy = reinterpret_cast<const OTPCPrimaryGeneratorAction*>(runManager->GetUserPrimaryGeneratorAction())->getEnergy();
+	G4AccumulableManager::Instance()->Reset();
+	auto numberOfEnergyPoints = runConfiguration.getNumberOfEnergyPoints();
+	compactEncoding = runConfiguration.isCompactEncoding();
+	compactEncoder = OTPCCompactEncoder(runConfiguration.getFixedPointStep());
+	triggerCounters.resize(numberOfEnergyPoints);
+	stackingCounters.resize(runConfiguration.getStackingRules().getRules().size());
+	if (runConfiguration.getSummarySettings().enabled) {
+		std::vector<double> energies;
+		for (std::size_t energyIndex = 0; energyIndex < numberOfEnergyPoints; energyIndex++) {
+			energies.push_back(runConfiguration.getEnergyPoint(energyIndex).energy / keV);
+		}
+		runSummary.resize(runConfiguration.getSummarySettings(), energies);
+	}
+	if (IsMaster()) {
+		// master begins the run before any worker starts processing events
+		eventIndex = 0;
+		auto stepTracePath = getStepTracePath(runConfiguration);
+		stepTrace = std::make_unique<OTPCStepTraceWriter>(runConfiguration.isForkedWorker() ? shardFilePath(stepTracePath, runConfiguration.getShardID()) : stepTracePath);
+	}
+	// in MT mode the master does not process events, workers write to their own shards without locking
+	if (!IsMaster() || !G4Threading::IsMultithreadedApplication()) {
+		auto outputPath = [&](const std::filesystem::path& filePath) {
+			return shardFilePath(filePath, runConfiguration.getShardID());
+		};
+		// block size aligned to 4 kB pages, smaller blocks when there are many energy points
+		auto columnsPerEnergy = getContainerSchema(runConfiguration).size();
+		auto numberOfFiles = columnsPerEnergy * numberOfEnergyPoints;
+		auto blockSize = std::clamp(eventWriterBufferSize / numberOfFiles, minimalBlockSize, maximalBlockSize) & ~std::size_t(4095);
+		eventWriter = std::make_unique<OTPCAsyncWriter>(blockSize);
+		auto shardedFiles = getShardedFiles(runConfiguration);
+		energyOutputs.clear();
+		energyOutputs.resize(numberOfEnergyPoints);
+		for (std::size_t energyIndex = 0; energyIndex < numberOfEnergyPoints; energyIndex++) {
+			auto& energyOutput = energyOutputs[energyIndex];
+			//eventTotalDepositFile.open(eventTotalDepositFilePath.string() + ".csv", std::ios_base::out | std::ios_base::trunc);
+			//eventStepsDepositFile.open(eventStepsDepositFilePath.string() + ".csv", std::ios_base::out | std::ios_base::trunc);
+			auto shardedFile = shardedFiles.begin() + columnsPerEnergy * energyIndex;
+			energyOutput.eventTotalDepositFileBinary = eventWriter->open(outputPath(shardedFile[crystalsColumn].filePath));
+			energyOutput.eventTotalGasDepositFileBinary = eventWriter->open(outputPath(shardedFile[gasColumn].filePath));
+			energyOutput.metaFile = eventWriter->open(outputPath(shardedFile[primaryColumn].filePath));
+			if (runConfiguration.getTrigger().isEnabled()) {
+				energyOutput.eventNumberFile = eventWriter->open(outputPath(shardedFile[eventColumn].filePath));
+				energyOutput.triggerFile = eventWriter->open(outputPath(shardedFile[triggerColumn].filePath));
+			}
+		}
+		//eventStepsDepositFileBinary.open(eventStepsDepositFilePath.string() + ".bin", std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		// one writer for the lifetime of the thread, parts are started only at the size limit;
+		// a new one when the run directory changed (jobs of the server)
+		auto voxelFilePrefix = runConfiguration.getRunPath() / std::format("voxels_s{}", std::max<int64_t>(runConfiguration.getShardID(), 0));
+		if (runConfiguration.getVoxelGrid().isEnabled() && (!voxelWriter || voxelWriter->getFilePrefix() != voxelFilePrefix)) {
+			std::vector<std::string> labelNames(OTPCPrimaryGeneratorAction::primaryInfoNames.begin(), OTPCPrimaryGeneratorAction::primaryInfoNames.end());
+			voxelWriter = std::make_unique<OTPCVoxelWriter>(voxelFilePrefix, runConfiguration.getVoxelGrid(), labelNames, runConfiguration.getVoxelFileSize());
+		}
+	}
 	//Start CPU timer
 	timer->Start();
-	eventIndex = 0;
 }
 
 void OTPCRunAction::EndOfRunAction(const G4Run*)
 {
-
+	//Stop timer and get CPU time
+	timer->Stop();
+	G4AccumulableManager::Instance()->Merge();
 	//eventTotalDepositFile.close();
 	//eventStepsDepositFile.close();
-	eventTotalDepositFileBinary.close();
-	eventTotalGasDepositFileBinary.close();
+	// all buffered events are on disk before the master merges the shards
+	if (eventWriter) {
+		eventWriter->close();
+		eventWriter.reset();
+	}
+	energyOutputs.clear();
+	// the part stays open for the next run, its events are on disk before the checkpoint records its size
+	if (voxelWriter) {
+		voxelWriter->flush();
+	}
 	//eventStepsDepositFileBinary.close();
-	//Stop timer and get CPU time
-	timer->Stop();
+	if (!IsMaster()) {
+		return;
+	}
+	stepTrace.reset();
+
+	// forked workers leave their shards for the parent process
+	if (!runConfiguration.isForkedWorker()) {
+		// workers are finished and their shards closed at this point
+		mergeIntoContainer(runConfiguration);
+	}
+	if (runConfiguration.getTrigger().isEnabled()) {
+		writeTriggerSummary();
+	}
+	if (runConfiguration.getStackingRules().isEnabled()) {
+		writeStackingSummary();
+	}
+	if (runConfiguration.getSummarySettings().enabled) {
+		auto summaryPath = getSummaryPath(runConfiguration);
+		if (runConfiguration.isForkedWorker()) {
+			runSummary.append(shardFilePath(summaryPath, runConfiguration.getShardID()));
+		}
+		else {
+			runSummary.append(summaryPath);
+			OTPCRunSummary::writeJSON(summaryPath);
+		}
+	}
 	G4double cputime = timer->GetRealElapsed();
-	std::cout << std::format("Flags set = {} \n CPU time = {} s\n", eventFlagCounter, cputime);
+	std::cout << std::format("Flags set = {} \n Decays = {} \n CPU time = {} s\n", eventFlagCounter.GetValue(), decayCounter.GetValue(), cputime);
 
 }
 
-void OTPCRunAction::fillOut(std::vector<std::array<G4double, 4>>& EnergyDeposit) {
-	if (EnergyDeposit.size() > 0) {
-		eventStepsDepositFile << std::format("{}\t{}\n", eventIndex, EnergyDeposit.size());
-		for (auto& EnergyDeposit_i : EnergyDeposit) {
-			eventStepsDepositFile << std::format("{},{},{},{}\n", EnergyDeposit_i[0], EnergyDeposit_i[1], EnergyDeposit_i[2], EnergyDeposit_i[3]);
+void OTPCRunAction::fillOutEvent(std::array<G4double, 20>& EnergyGammaCrystals, G4double EnergyGas, bool includeScintillation, G4int eventID) {
+	auto generatorAction = static_cast<const OTPCPrimaryGeneratorAction*>(runManager->GetUserPrimaryGeneratorAction());
+	currentEnergyIndex = runConfiguration.getEnergyIndex(eventID);
+	currentEventKey = runConfiguration.getGlobalEventNumber(eventID);
+	currentEventWritten = false;
+
+	// summary covers all simulated events, not only the written ones
+	if (runConfiguration.getSummarySettings().enabled) {
+		runSummary.fill(currentEnergyIndex, EnergyGammaCrystals, EnergyGas);
+	}
+
+	// trigger stage, rejected events are only counted unless they are in the prescaled sample
+	auto& trigger = runConfiguration.getTrigger();
+	uint8_t failedConditions = 0;
+	if (trigger.isEnabled()) {
+		failedConditions = trigger.evaluate(EnergyGammaCrystals, EnergyGas);
+		triggerCounters.count(currentEnergyIndex, OTPCTriggerCounters::processedCounter);
+		for (std::size_t condition = 0; condition < OTPCTrigger::numberOfConditions; condition++) {
+			if (failedConditions & (1 << condition)) {
+				triggerCounters.count(currentEnergyIndex, OTPCTriggerCounters::firstConditionCounter + condition);
+			}
+		}
+		if (failedConditions == 0) {
+			triggerCounters.count(currentEnergyIndex, OTPCTriggerCounters::acceptedCounter);
 		}
+		else if (trigger.isPrescaled(currentEventKey)) {
+			triggerCounters.count(currentEnergyIndex, OTPCTriggerCounters::prescaledCounter);
+		}
+		else {
+			return;
+		}
+		writeRecord(energyOutputs[currentEnergyIndex].eventNumberFile, &currentEventKey, sizeof(currentEventKey));
+		writeRecord(energyOutputs[currentEnergyIndex].triggerFile, &failedConditions, sizeof(failedConditions));
+	}
+	fillOutGasIonization(EnergyGas);
+	if (includeScintillation) {
+		fillOutScintillation(EnergyGammaCrystals);
 	}
+	fillOutMetadata(generatorAction->getPrimaryInfo());
+	currentEventWritten = true;
+
+	if (auto eventStream = runConfiguration.getEventStream()) {
+		// every worker thread or forked worker is the only producer of its ring
+		OTPCStreamRecord record;
+		record.event = currentEventKey;
+		record.energy = runConfiguration.getEnergyPoint(currentEnergyIndex).energy;
+		record.crystals = EnergyGammaCrystals;
+		record.gas = EnergyGas;
+		record.primary = generatorAction->getPrimaryInfo();
+		record.trigger = failedConditions;
+		eventStream->publish(std::max<int64_t>(runConfiguration.getShardID(), 0), record);
+	}
+}
+
+void OTPCRunAction::fillOutVoxels(std::vector<std::pair<uint32_t, G4double>>& VoxelDeposits) {
+	// events without gas deposits carry no track, they are left out of the training data
+	if (!voxelWriter || !currentEventWritten || VoxelDeposits.empty()) {
+		return;
+	}
+	auto generatorAction = static_cast<const OTPCPrimaryGeneratorAction*>(runManager->GetUserPrimaryGeneratorAction());
+	voxelWriter->writeEvent(currentEventKey, runConfiguration.getEnergyPoint(currentEnergyIndex).energy / MeV, generatorAction->getPrimaryInfo(), VoxelDeposits);
 }
 
 void OTPCRunAction::fillOutScintillation(std::array<G4double, 20>& EnergyGammaCrystals) {
-	eventTotalDepositFileBinary.write((char*)EnergyGammaCrystals.data(), EnergyGammaCrystals.size() * sizeof(G4double));
+	if (compactEncoding) { // only crystals with a deposit
+		compactEncoder.encodeCrystals(EnergyGammaCrystals, compactRecord);
+		writeRecord(energyOutputs[currentEnergyIndex].eventTotalDepositFileBinary, compactRecord.data(), compactRecord.size(), true);
+		return;
+	}
+	writeRecord(energyOutputs[currentEnergyIndex].eventTotalDepositFileBinary, EnergyGammaCrystals.data(), EnergyGammaCrystals.size() * sizeof(G4double));
 
 	//for (auto& EnergyDepositOneCrystal : EnergyGammaCrystals) {
 	//	eventTotalDepositFile << EnergyDepositOneCrystal << '\t';
@@ -93,33 +302,197 @@ void OTPCRunAction::fillOutScintillation(std::array<G4double, 20>& EnergyGammaCr
 }
 
 void OTPCRunAction::fillOutGasIonization(G4double EnergyGas) {
-	eventTotalGasDepositFileBinary.write((char*)&EnergyGas, sizeof(EnergyGas));
+	if (compactEncoding) {
+		char record[OTPCCompactEncoder::depositSize];
+		compactEncoder.encodeGas(EnergyGas, record);
+		writeRecord(energyOutputs[currentEnergyIndex].eventTotalGasDepositFileBinary, record, sizeof(record));
+		return;
+	}
+	writeRecord(energyOutputs[currentEnergyIndex].eventTotalGasDepositFileBinary, &EnergyGas, sizeof(EnergyGas));
+}
+
+void OTPCRunAction::fillOutMetadata(const std::array<G4double, 12>& primaryInfo) {
+	if (compactEncoding) {
+		char record[OTPCCompactEncoder::primaryRecordSize];
+		OTPCCompactEncoder::encodePrimary(primaryInfo, record);
+		writeRecord(energyOutputs[currentEnergyIndex].metaFile, record, sizeof(record));
+		return;
+	}
+	writeRecord(energyOutputs[currentEnergyIndex].metaFile, primaryInfo.data(), sizeof(primaryInfo));
+}
+
+void OTPCRunAction::writeRecord(std::size_t file, const void* data, std::size_t size, bool sizePrefix) {
+	// event key lets the master restore the event order when merging
+	eventWriter->write(file, &currentEventKey, sizeof(currentEventKey));
+	if (sizePrefix) {
+		uint16_t recordSize = uint16_t(size);
+		eventWriter->write(file, &recordSize, sizeof(recordSize));
+	}
+	eventWriter->write(file, data, size);
 }
 
-void OTPCRunAction::fillOutSteps(std::vector<std::tuple<G4double, G4double, G4double, G4String>>& ProcessSteps, G4double totalEnergy) {
-	decayCounter += std::any_of(std::execution::par, ProcessSteps.begin(), ProcessSteps.end(),
-		[](const std::tuple<G4double, G4double, G4double, G4String>& tuple) {
-			return std::get<3>(tuple).find("RadioactiveDecay") != std::string::npos;
-		});
-	if (ProcessSteps.size() > 0 && totalEnergy > currentEnergy * 1.001) {
-		eventStepsDepositFile.open(eventStepsDepositFilePath.string() + std::format("_{}.txt", eventIndex), std::ios_base::out | std::ios_base::trunc);
-		for (auto [x, y, z, step] : ProcessSteps) {
-			eventStepsDepositFile << std::format("{}\t{}\t{}\t{}\n", x, y, z, step);
+void OTPCRunAction::fillOutSteps(std::vector<OTPCStep>& ProcessSteps, bool decay, G4double totalEnergy, G4int eventID) {
+	decayCounter += decay;
+	auto& energyPoint = runConfiguration.getEnergyPoint(runConfiguration.getEnergyIndex(eventID));
+	// replayed events are traced in full, they were selected already
+	if (ProcessSteps.size() > 0 && (runConfiguration.isStepCapture() || totalEnergy > energyPoint.energy * 1.001)) {
+		// all selected events of the run go to one file instead of a text file per event
+		stepTrace->writeEvent(runConfiguration.getGlobalEventNumber(eventID), energyPoint.energy, ProcessSteps);
+	}
+}
+
+void OTPCRunAction::writeTriggerSummary() {
+	// one line per energy point and run, forked workers write theirs to shards merged by the parent
+	std::string summary;
+	for (std::size_t energyIndex = 0; energyIndex < runConfiguration.getNumberOfEnergyPoints(); energyIndex++) {
+		summary += std::format("{}", runConfiguration.getEnergyPoint(energyIndex).energy / keV);
+		for (std::size_t counter = 0; counter < OTPCTriggerCounters::countersPerEnergy; counter++) {
+			summary += std::format("\t{}", triggerCounters.get(energyIndex, counter));
 		}
-		eventStepsDepositFile.close();
+		summary += '\n';
 	}
+	auto summaryPath = getTriggerSummaryPath(runConfiguration);
+	if (runConfiguration.isForkedWorker()) {
+		appendTable(shardFilePath(summaryPath, runConfiguration.getShardID()), "", summary);
+	}
+	else {
+		appendTable(summaryPath, triggerSummaryHeader(), summary);
+	}
+	std::cout << "Trigger (processed, accepted, prescaled, failed conditions):\n" << summary;
+}
+
+void OTPCRunAction::writeStackingSummary() {
+	// one line per rule and run, so the tracks and energy every shortcut removed stay visible;
+	// forked workers write theirs to shards merged by the parent
+	std::string summary;
+	auto& rules = runConfiguration.getStackingRules().getRules();
+	for (std::size_t ruleIndex = 0; ruleIndex < rules.size(); ruleIndex++) {
+		summary += std::format("{}\t{}\t{}\t{}\n", ruleIndex, rules[ruleIndex].description, stackingCounters.getTracks(ruleIndex), stackingCounters.getEnergy(ruleIndex));
+	}
+	auto summaryPath = getStackingSummaryPath(runConfiguration);
+	if (runConfiguration.isForkedWorker()) {
+		appendTable(shardFilePath(summaryPath, runConfiguration.getShardID()), "", summary);
+	}
+	else {
+		appendTable(summaryPath, stackingSummaryHeader, summary);
+	}
+	std::cout << "Stacking rules (rule, tracks, kinetic energy in keV):\n" << summary;
+}
+
+OTPCStackingCounters& OTPCRunAction::getStackingCounters() {
+	return stackingCounters;
 }
 
 void OTPCRunAction::updateEventCounter(bool flag) {
 	eventFlagCounter += flag;
-	eventIndex++;
-	if (eventIndex % 10000 == 0) {
-		std::cout << eventIndex << '\n';
+	auto processedEvents = ++eventIndex;
+	if (processedEvents % 10000 == 0) {
+		std::cout << processedEvents << '\n';
 	}
 }
 
-void OTPCRunAction::setEventFilePath(std::filesystem::path totalP, std::filesystem::path stepsP) {
-	eventTotalDepositFilePath = totalP;
-	eventStepsDepositFilePath = stepsP;
-	std::cout << eventTotalDepositFilePath << '\n' << eventStepsDepositFilePath << '\n';
+std::vector<OTPCColumn> OTPCRunAction::getContainerSchema(const OTPCRunConfiguration& config) {
+	std::vector<OTPCColumn> schema;
+	if (config.isCompactEncoding()) {
+		auto depositEncoding = OTPCCompactEncoder(config.getFixedPointStep()).describe();
+		auto depositType = config.getFixedPointStep() > 0 ? OTPCColumnType::uint32 : OTPCColumnType::float32;
+		schema = {
+			{ "crystals", OTPCColumnType::variable, 0, "hitmask/" + depositEncoding },
+			{ "gas", depositType, 1, depositEncoding },
+			{ "primary", OTPCColumnType::uint8, OTPCCompactEncoder::primaryRecordSize, "quantized" } };
+	}
+	else {
+		schema = {
+			{ "crystals", OTPCColumnType::float64, 20 },
+			{ "gas", OTPCColumnType::float64, 1 },
+			{ "primary", OTPCColumnType::float64, 12 } };
+	}
+	if (config.getTrigger().isEnabled()) {
+		schema.push_back({ "event", OTPCColumnType::uint64, 1 });
+		schema.push_back({ "trigger", OTPCColumnType::uint8, 1, "failed conditions: 1 multiplicity, 2 gas, 4 sum" });
+	}
+	return schema;
+}
+
+std::filesystem::path OTPCRunAction::getContainerPath(const OTPCRunConfiguration& config) {
+	return config.getRunPath() / "events.otpc";
+}
+
+std::vector<OTPCShardedFile> OTPCRunAction::getShardedFiles(const OTPCRunConfiguration& config) {
+	std::vector<OTPCShardedFile> shardedFiles;
+	for (std::size_t energyIndex = 0; energyIndex < config.getNumberOfEnergyPoints(); energyIndex++) {
+		auto& energyPoint = config.getEnergyPoint(energyIndex);
+		auto eventTotalDepositFileName = energyPoint.eventTotalDepositFilePath.string();
+		shardedFiles.push_back({ eventTotalDepositFileName + ".bin", crystalsColumn, energyPoint.energy });
+		shardedFiles.push_back({ eventTotalDepositFileName + "_gas.bin", gasColumn, energyPoint.energy });
+		shardedFiles.push_back({ eventTotalDepositFileName + "_metadata.bin", primaryColumn, energyPoint.energy });
+		if (config.getTrigger().isEnabled()) {
+			shardedFiles.push_back({ eventTotalDepositFileName + "_event.bin", eventColumn, energyPoint.energy });
+			shardedFiles.push_back({ eventTotalDepositFileName + "_trigger.bin", triggerColumn, energyPoint.energy });
+		}
+	}
+	return shardedFiles;
+}
+
+void OTPCRunAction::mergeIntoContainer(const OTPCRunConfiguration& config) {
+	OTPCContainerWriter container(getContainerPath(config), getContainerSchema(config));
+	mergeShards(getShardedFiles(config), container);
+	container.close();
+}
+
+std::filesystem::path OTPCRunAction::getTriggerSummaryPath(const OTPCRunConfiguration& config) {
+	return config.getRunPath() / "trigger.txt";
+}
+
+std::filesystem::path OTPCRunAction::getStackingSummaryPath(const OTPCRunConfiguration& config) {
+	return config.getRunPath() / "stacking.txt";
+}
+
+std::filesystem::path OTPCRunAction::getStepTracePath(const OTPCRunConfiguration& config) {
+	return config.getRunPath() / "steps.trace";
+}
+
+void OTPCRunAction::mergeStepTraces(const OTPCRunConfiguration& config) {
+	auto stepTracePath = getStepTracePath(config);
+	auto shards = findShards(stepTracePath);
+	if (shards.empty()) {
+		return;
+	}
+	OTPCStepTraceWriter trace(stepTracePath);
+	for (const auto& shard : shards) {
+		trace.appendTrace(shard);
+	}
+	trace.close();
+	for (const auto& shard : shards) {
+		std::filesystem::remove(shard);
+	}
+}
+
+std::filesystem::path OTPCRunAction::getSummaryPath(const OTPCRunConfiguration& config) {
+	return config.getRunPath() / "summary.hist";
+}
+
+void OTPCRunAction::mergeSummaries(const OTPCRunConfiguration& config) {
+	mergeTableShards(getTriggerSummaryPath(config), triggerSummaryHeader());
+	mergeTableShards(getStackingSummaryPath(config), stackingSummaryHeader);
+	auto summaryPath = getSummaryPath(config);
+	auto shards = findShards(summaryPath);
+	if (shards.empty()) {
+		return;
+	}
+	// records are self-contained, shards are appended as they are
+	std::ofstream summaryFile(summaryPath, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+	for (const auto& shard : shards) {
+		std::ifstream shardFile(shard, std::ios_base::in | std::ios_base::binary);
+		summaryFile << shardFile.rdbuf();
+	}
+	summaryFile.close();
+	if (!summaryFile) {
+		std::cout << "Cannot write " << summaryPath << '\n';
+		exit(1);
+	}
+	for (const auto& shard : shards) {
+		std::filesystem::remove(shard);
+	}
+	OTPCRunSummary::writeJSON(summaryPath);
 }
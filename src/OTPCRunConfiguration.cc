@@ -0,0 +1,234 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Run settings shared by the master and all worker threads
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCRunConfiguration.hh"
+
+#include "G4ios.hh"
+#include "G4Threading.hh"
+#include <fstream>
+#include <iostream>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCRunConfiguration::OTPCRunConfiguration(bool loadDataFromFileArg) : loadDataFromFile(loadDataFromFileArg) {
+	singleEnergyPoint.energy = E[0];
+	if (loadDataFromFile) {
+		loadData();
+	}
+}
+
+G4double OTPCRunConfiguration::getEnergy(int index) const {
+	return E[index];
+}
+
+void OTPCRunConfiguration::setEnergy(G4double energy, int index) {
+	E[index] = energy;
+	if (index == 0) {
+		singleEnergyPoint.energy = energy;
+	}
+}
+
+G4int OTPCRunConfiguration::getParticleType(int index) const {
+	return type[index];
+}
+
+const G4ThreeVector& OTPCRunConfiguration::getPosition() const {
+	return position;
+}
+
+void OTPCRunConfiguration::setPosition(G4ThreeVector pos) {
+	position = pos;
+}
+
+bool OTPCRunConfiguration::isDataLoadedFromFile() const {
+	return loadDataFromFile;
+}
+
+std::filesystem::path OTPCRunConfiguration::getParticleFilePath() {
+	return "../../../particles3.data";
+}
+
+void OTPCRunConfiguration::setRunPath(std::filesystem::path runPath) {
+	runDirectoryPath = runPath;
+}
+
+const std::filesystem::path& OTPCRunConfiguration::getRunPath() const {
+	return runDirectoryPath;
+}
+
+void OTPCRunConfiguration::setEventFilePath(std::filesystem::path totalP, std::filesystem::path stepsP) {
+	singleEnergyPoint.eventTotalDepositFilePath = totalP;
+	singleEnergyPoint.eventStepsDepositFilePath = stepsP;
+	std::cout << totalP << '\n' << stepsP << '\n';
+}
+
+const std::filesystem::path& OTPCRunConfiguration::getEventTotalDepositFilePath() const {
+	return singleEnergyPoint.eventTotalDepositFilePath;
+}
+
+const std::filesystem::path& OTPCRunConfiguration::getEventStepsDepositFilePath() const {
+	return singleEnergyPoint.eventStepsDepositFilePath;
+}
+
+void OTPCRunConfiguration::setEnergySweep(std::vector<OTPCEnergyPoint> points) {
+	energySweep = std::move(points);
+	for (const auto& point : energySweep) {
+		std::cout << point.energy / keV << " keV: " << point.eventTotalDepositFilePath << '\n';
+	}
+}
+
+bool OTPCRunConfiguration::isEnergySweep() const {
+	return !energySweep.empty();
+}
+
+std::size_t OTPCRunConfiguration::getNumberOfEnergyPoints() const {
+	return isEnergySweep() ? energySweep.size() : 1;
+}
+
+const OTPCEnergyPoint& OTPCRunConfiguration::getEnergyPoint(std::size_t energyIndex) const {
+	return isEnergySweep() ? energySweep[energyIndex] : singleEnergyPoint;
+}
+
+std::size_t OTPCRunConfiguration::getEnergyIndex(G4int eventID) const {
+	return eventID % getNumberOfEnergyPoints();
+}
+
+G4int OTPCRunConfiguration::getEventNumber(G4int eventID) const {
+	return eventID / G4int(getNumberOfEnergyPoints());
+}
+
+void OTPCRunConfiguration::setEventNumbering(uint64_t firstEventNumberArg, uint64_t eventsPerEnergyPointArg) {
+	firstEventNumber = firstEventNumberArg;
+	eventsPerEnergyPoint = eventsPerEnergyPointArg;
+}
+
+uint64_t OTPCRunConfiguration::getGlobalEventNumber(G4int eventID) const {
+	if (!replayEvents.empty()) {
+		return replayEvents[getEventNumber(eventID)];
+	}
+	return firstEventNumber + getEventNumber(eventID);
+}
+
+uint64_t OTPCRunConfiguration::getEventsPerEnergyPoint() const {
+	return eventsPerEnergyPoint;
+}
+
+void OTPCRunConfiguration::setReplayEvents(std::vector<uint64_t> eventNumbers) {
+	replayEvents = std::move(eventNumbers);
+}
+
+void OTPCRunConfiguration::setForkedWorker(int64_t workerID) {
+	forkedWorkerID = workerID;
+}
+
+bool OTPCRunConfiguration::isForkedWorker() const {
+	return forkedWorkerID >= 0;
+}
+
+int64_t OTPCRunConfiguration::getShardID() const {
+	return isForkedWorker() ? forkedWorkerID : G4Threading::G4GetThreadId();
+}
+
+void OTPCRunConfiguration::setCompactEncoding(bool compact, G4double fixedPointStepArg) {
+	compactEncoding = compact;
+	fixedPointStep = fixedPointStepArg;
+}
+
+bool OTPCRunConfiguration::isCompactEncoding() const {
+	return compactEncoding;
+}
+
+G4double OTPCRunConfiguration::getFixedPointStep() const {
+	return fixedPointStep;
+}
+
+void OTPCRunConfiguration::setTrigger(const OTPCTrigger& triggerArg) {
+	trigger = triggerArg;
+}
+
+const OTPCTrigger& OTPCRunConfiguration::getTrigger() const {
+	return trigger;
+}
+
+void OTPCRunConfiguration::setStackingRules(const OTPCStackingRules& stackingRulesArg) {
+	stackingRules = stackingRulesArg;
+}
+
+const OTPCStackingRules& OTPCRunConfiguration::getStackingRules() const {
+	return stackingRules;
+}
+
+void OTPCRunConfiguration::setRunSeed(uint64_t seed) {
+	runSeed = seed;
+}
+
+uint64_t OTPCRunConfiguration::getRunSeed() const {
+	return runSeed;
+}
+
+void OTPCRunConfiguration::setEventStream(OTPCEventStream* stream) {
+	eventStream = stream;
+}
+
+OTPCEventStream* OTPCRunConfiguration::getEventStream() const {
+	return eventStream;
+}
+
+void OTPCRunConfiguration::setSummarySettings(const OTPCSummarySettings& settings) {
+	summarySettings = settings;
+}
+
+const OTPCSummarySettings& OTPCRunConfiguration::getSummarySettings() const {
+	return summarySettings;
+}
+
+void OTPCRunConfiguration::setVoxelExport(const OTPCVoxelGrid& grid, uint64_t maxFileSize) {
+	voxelGrid = grid;
+	voxelFileSize = maxFileSize;
+}
+
+const OTPCVoxelGrid& OTPCRunConfiguration::getVoxelGrid() const {
+	return voxelGrid;
+}
+
+uint64_t OTPCRunConfiguration::getVoxelFileSize() const {
+	return voxelFileSize;
+}
+
+void OTPCRunConfiguration::setStepCapture(bool capture) {
+	stepCapture = capture;
+}
+
+bool OTPCRunConfiguration::isStepCapture() const {
+	return stepCapture;
+}
+
+void OTPCRunConfiguration::loadData() {
+	//////////Reading the input data for primary generator///////////
+
+	std::ifstream evenInputInformation;
+	evenInputInformation.open(getParticleFilePath());
+	if (!evenInputInformation.is_open()) {
+		std::cout << "\n\nNO EVENT INPUT INFORMATION FILE FOUND!!!" << _endl_;
+		exit(1);
+	}
+	std::string header1, header2;
+
+	evenInputInformation >> header1;
+	evenInputInformation >> type[0] >> type[1] >> type[2];
+	evenInputInformation >> header2;
+	evenInputInformation >> E[0] >> E[1] >> E[2];
+	evenInputInformation.close();
+	for (auto& energy : E) {
+		energy *= keV;
+	}
+	singleEnergyPoint.energy = E[0];
+	G4cout << E[0] / keV << " " << E[1] / keV << " " << E[2] / keV << '\n';
+}
@@ -0,0 +1,292 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Summary statistics accumulated during the run
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCRunSummary.hh"
+
+#include <fstream>
+#include <iostream>
+#include <format>
+#include <map>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const char recordMagic[8] = { 'O', 'T', 'P', 'C', 'S', 'U', 'M', '2' };
+
+	// fraction of the events with its binomial uncertainty
+	std::string jsonEfficiency(const std::string& name, uint64_t count, uint64_t events) {
+		double efficiency = events > 0 ? double(count) / events : 0;
+		double error = events > 0 ? std::sqrt(efficiency * (1 - efficiency) / events) : 0;
+		return std::format("\t\"{}\": {},\n\t\"{}_error\": {},\n", name, efficiency, name, error);
+	}
+
+	std::string jsonArray(const std::vector<std::string>& values) {
+		std::string array = "[";
+		for (std::size_t i = 0; i < values.size(); i++) {
+			array += (i > 0 ? ", " : "") + values[i];
+		}
+		return array + "]";
+	}
+
+	// trailing empty bins are left out
+	std::string jsonHistogram(const OTPCHistogram& histogram) {
+		auto& counts = histogram.getCounts();
+		auto lastBin = std::find_if(counts.rbegin(), counts.rend(), [](uint64_t count) { return count > 0; });
+		std::vector<std::string> values;
+		for (auto count = counts.begin(); count != lastBin.base(); count++) {
+			values.push_back(std::format("{}", *count));
+		}
+		return std::format("{{ \"bin_width_keV\": {}, \"bins\": {}, \"overflow\": {}, \"counts\": {} }}",
+			histogram.getBinWidth(), counts.size(), histogram.getOverflow(), jsonArray(values));
+	}
+}
+
+OTPCEnergySummary::OTPCEnergySummary(double energyArg, const OTPCSummarySettings& settings) :
+	energy(energyArg),
+	threshold(settings.threshold),
+	peakWindow(settings.peakWindow),
+	sum(settings.binWidth, settings.maximum),
+	addback(settings.binWidth, settings.maximum),
+	gas(settings.gasBinWidth, settings.gasMaximum),
+	coincidenceBinWidth(settings.coincidenceBinWidth),
+	coincidenceBins(settings.coincidenceBinWidth > 0 ? uint32_t(std::ceil(settings.maximum / settings.coincidenceBinWidth)) : 0)
+{
+	if (settings.coincidenceBinWidth > 0 && settings.maximum / settings.coincidenceBinWidth > double(UINT32_MAX / (numberOfCrystals * numberOfCrystals) - 1)) {
+		std::cout << "Coincidence bins are too narrow" << _endl_;
+		exit(1);
+	}
+}
+
+void OTPCEnergySummary::fill(const std::array<G4double, numberOfCrystals>& crystalDeposits, G4double gasDeposit) {
+	events++;
+	double eventSum = 0;
+	uint32_t hitMask = 0;
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		bool hit = crystalDeposits[crystal] > threshold;
+		crystalHits[crystal] += hit;
+		eventSum += hit ? crystalDeposits[crystal] : 0;
+		hitMask |= uint32_t(hit) << crystal;
+	}
+	if (hitMask) {
+		detectedEvents++;
+		peakEvents += std::abs(eventSum - energy) <= peakWindow;
+		sum.fill(eventSum);
+		OTPCCrystalLayout::get().addback(crystalDeposits.data(), threshold, clusters);
+		bool addbackPeak = false;
+		for (auto cluster : clusters) {
+			addback.fill(cluster);
+			addbackPeak |= std::abs(cluster - energy) <= peakWindow;
+		}
+		addbackPeakEvents += addbackPeak;
+		// most events hit a single crystal and have no coincidences
+		if (coincidenceBins > 0 && std::popcount(hitMask) > 1) {
+			fillCoincidences(crystalDeposits, hitMask);
+		}
+	}
+	if (gasDeposit > 0) {
+		gasEvents++;
+		gas.fill(gasDeposit);
+	}
+}
+
+void OTPCEnergySummary::fillCoincidences(const std::array<G4double, numberOfCrystals>& crystalDeposits, uint32_t hitMask) {
+	for (auto remainingA = hitMask; remainingA; remainingA &= remainingA - 1) {
+		auto a = std::countr_zero(remainingA);
+		auto bin = uint32_t(std::min(crystalDeposits[a] / coincidenceBinWidth, double(coincidenceBins)));
+		for (auto remainingB = hitMask & ~(1u << a); remainingB; remainingB &= remainingB - 1) {
+			auto b = std::countr_zero(remainingB);
+			coincidences[uint32_t(a * numberOfCrystals + b) * (coincidenceBins + 1) + bin]++;
+		}
+	}
+}
+
+void OTPCEnergySummary::add(const OTPCEnergySummary& other) {
+	if (other.threshold != threshold || other.peakWindow != peakWindow ||
+		other.sum.getBinWidth() != sum.getBinWidth() || other.sum.getCounts().size() != sum.getCounts().size() ||
+		other.gas.getBinWidth() != gas.getBinWidth() || other.gas.getCounts().size() != gas.getCounts().size() ||
+		other.coincidenceBinWidth != coincidenceBinWidth || other.coincidenceBins != coincidenceBins) {
+		std::cout << std::format("Summaries of {} keV have different settings, use the same summary options for all runs", energy) << _endl_;
+		exit(1);
+	}
+	events += other.events;
+	detectedEvents += other.detectedEvents;
+	peakEvents += other.peakEvents;
+	addbackPeakEvents += other.addbackPeakEvents;
+	gasEvents += other.gasEvents;
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		crystalHits[crystal] += other.crystalHits[crystal];
+	}
+	sum.add(other.sum);
+	addback.add(other.addback);
+	gas.add(other.gas);
+	for (auto [key, count] : other.coincidences) {
+		coincidences[key] += count;
+	}
+}
+
+void OTPCEnergySummary::reset() {
+	events = detectedEvents = peakEvents = addbackPeakEvents = gasEvents = 0;
+	crystalHits.fill(0);
+	sum.clear();
+	addback.clear();
+	gas.clear();
+	coincidences.clear();
+}
+
+double OTPCEnergySummary::getEnergy() const {
+	return energy;
+}
+
+void OTPCEnergySummary::write(std::ostream& stream) const {
+	stream.write(recordMagic, sizeof(recordMagic));
+	for (auto value : { energy, threshold, peakWindow, coincidenceBinWidth }) {
+		stream.write((const char*)&value, sizeof(value));
+	}
+	for (auto counter : { events, detectedEvents, peakEvents, addbackPeakEvents, gasEvents }) {
+		stream.write((const char*)&counter, sizeof(counter));
+	}
+	stream.write((const char*)crystalHits.data(), sizeof(crystalHits));
+	sum.write(stream);
+	addback.write(stream);
+	gas.write(stream);
+	// sorted, so records do not depend on the hash table
+	std::vector<std::pair<uint32_t, uint64_t>> entries(coincidences.begin(), coincidences.end());
+	std::sort(entries.begin(), entries.end());
+	uint64_t numberOfEntries = entries.size();
+	stream.write((const char*)&coincidenceBins, sizeof(coincidenceBins));
+	stream.write((const char*)&numberOfEntries, sizeof(numberOfEntries));
+	for (auto [key, count] : entries) {
+		stream.write((const char*)&key, sizeof(key));
+		stream.write((const char*)&count, sizeof(count));
+	}
+}
+
+bool OTPCEnergySummary::read(std::istream& stream) {
+	char magic[sizeof(recordMagic)];
+	if (!stream.read(magic, sizeof(magic))) {
+		return false;
+	}
+	if (!std::equal(std::begin(recordMagic), std::end(recordMagic), magic)) {
+		std::cout << "Summary file is damaged" << _endl_;
+		exit(1);
+	}
+	for (auto value : { &energy, &threshold, &peakWindow, &coincidenceBinWidth }) {
+		stream.read((char*)value, sizeof(*value));
+	}
+	for (auto counter : { &events, &detectedEvents, &peakEvents, &addbackPeakEvents, &gasEvents }) {
+		stream.read((char*)counter, sizeof(*counter));
+	}
+	stream.read((char*)crystalHits.data(), sizeof(crystalHits));
+	uint64_t numberOfEntries = 0;
+	if (!stream || !sum.read(stream) || !addback.read(stream) || !gas.read(stream) ||
+		!stream.read((char*)&coincidenceBins, sizeof(coincidenceBins)) || !stream.read((char*)&numberOfEntries, sizeof(numberOfEntries))) {
+		std::cout << "Summary file is damaged" << _endl_;
+		exit(1);
+	}
+	coincidences.clear();
+	for (uint64_t entry = 0; entry < numberOfEntries; entry++) {
+		uint32_t key = 0;
+		uint64_t count = 0;
+		stream.read((char*)&key, sizeof(key));
+		stream.read((char*)&count, sizeof(count));
+		coincidences[key] += count;
+	}
+	if (!stream) {
+		std::cout << "Summary file is damaged" << _endl_;
+		exit(1);
+	}
+	return true;
+}
+
+void OTPCEnergySummary::writeJSON(const std::filesystem::path& jsonPath) const {
+	std::vector<std::string> hits, hitRates, entries;
+	for (auto crystalHit : crystalHits) {
+		hits.push_back(std::format("{}", crystalHit));
+		hitRates.push_back(std::format("{}", events > 0 ? double(crystalHit) / events : 0));
+	}
+	// [a, b, deposit bin of a, count] in key order, the bin past the last one is the overflow
+	std::vector<std::pair<uint32_t, uint64_t>> coincidenceEntries(coincidences.begin(), coincidences.end());
+	std::sort(coincidenceEntries.begin(), coincidenceEntries.end());
+	for (auto [key, count] : coincidenceEntries) {
+		auto pair = key / (coincidenceBins + 1);
+		entries.push_back(std::format("[{}, {}, {}, {}]", pair / numberOfCrystals, pair % numberOfCrystals, key % (coincidenceBins + 1), count));
+	}
+	std::ofstream jsonFile(jsonPath, std::ios_base::out | std::ios_base::trunc);
+	jsonFile << "{\n"
+		<< std::format("\t\"energy_keV\": {},\n\t\"threshold_keV\": {},\n\t\"peak_window_keV\": {},\n", energy, threshold, peakWindow)
+		<< std::format("\t\"events\": {},\n\t\"detected_events\": {},\n\t\"peak_events\": {},\n\t\"gas_events\": {},\n", events, detectedEvents, peakEvents, gasEvents)
+		<< jsonEfficiency("total_efficiency", detectedEvents, events)
+		<< jsonEfficiency("peak_efficiency", peakEvents, events)
+		<< jsonEfficiency("addback_peak_efficiency", addbackPeakEvents, events)
+		<< jsonEfficiency("gas_fraction", gasEvents, events)
+		<< std::format("\t\"crystal_hits\": {},\n\t\"crystal_hit_rates\": {},\n", jsonArray(hits), jsonArray(hitRates))
+		<< std::format("\t\"sum_spectrum\": {},\n\t\"addback_spectrum\": {},\n\t\"gas_spectrum\": {},\n", jsonHistogram(sum), jsonHistogram(addback), jsonHistogram(gas))
+		<< std::format("\t\"coincidences\": {{ \"bin_width_keV\": {}, \"bins\": {}, \"entries\": {} }}\n", coincidenceBinWidth, coincidenceBins, jsonArray(entries))
+		<< "}\n";
+	if (!jsonFile) {
+		std::cout << "Cannot write " << jsonPath << _endl_;
+		exit(1);
+	}
+}
+
+OTPCRunSummary::OTPCRunSummary(const G4String& name) : G4VAccumulable(name) {}
+
+void OTPCRunSummary::resize(const OTPCSummarySettings& settings, const std::vector<double>& energies) {
+	energySummaries.clear();
+	for (auto energy : energies) {
+		energySummaries.emplace_back(energy, settings);
+	}
+}
+
+void OTPCRunSummary::fill(std::size_t energyIndex, const std::array<G4double, 20>& crystalDeposits, G4double gasDeposit) {
+	energySummaries[energyIndex].fill(crystalDeposits, gasDeposit);
+}
+
+void OTPCRunSummary::Merge(const G4VAccumulable& other) {
+	auto& otherSummaries = static_cast<const OTPCRunSummary&>(other).energySummaries;
+	for (std::size_t energyIndex = 0; energyIndex < std::min(energySummaries.size(), otherSummaries.size()); energyIndex++) {
+		energySummaries[energyIndex].add(otherSummaries[energyIndex]);
+	}
+}
+
+void OTPCRunSummary::Reset() {
+	for (auto& energySummary : energySummaries) {
+		energySummary.reset();
+	}
+}
+
+void OTPCRunSummary::append(const std::filesystem::path& summaryPath) const {
+	std::ofstream summaryFile(summaryPath, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+	for (const auto& energySummary : energySummaries) {
+		energySummary.write(summaryFile);
+	}
+	if (!summaryFile) {
+		std::cout << "Cannot write " << summaryPath << _endl_;
+		exit(1);
+	}
+}
+
+void OTPCRunSummary::writeJSON(const std::filesystem::path& summaryPath) {
+	std::map<double, OTPCEnergySummary> energySummaries;
+	std::ifstream summaryFile(summaryPath, std::ios_base::in | std::ios_base::binary);
+	OTPCEnergySummary record;
+	while (record.read(summaryFile)) {
+		auto [energySummary, inserted] = energySummaries.try_emplace(record.getEnergy(), record);
+		if (!inserted) {
+			energySummary->second.add(record);
+		}
+	}
+	for (const auto& [energy, energySummary] : energySummaries) {
+		energySummary.writeJSON(summaryPath.parent_path() / std::format("summary_{}keV.json", energy));
+	}
+}
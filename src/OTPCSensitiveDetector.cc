@@ -0,0 +1,135 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Scoring of the deposits in the crystals and in the gas
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCSensitiveDetector.hh"
+#include "OTPCEventAction.hh"
+#include "OTPCRunConfiguration.hh"
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4VProcess.hh"
+#include "G4ProcessTable.hh"
+#include "G4EventManager.hh"
+#include "G4SystemOfUnits.hh"
+#include <algorithm>
+#include <iostream>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	// processes whose steps deposit energy in the volume, RangeCut - electrons deposited at once (OTPCRangeCut)
+	const std::vector<std::string>
+		scintillatorProcesses = { "compt", "eBrem", "msc", "phot", "eIoni", "UserMaxStep", "RangeCut" },
+		gasProcesses = { "eIoni", "hIoni", "UserMaxStep", "RangeCut" };
+
+	OTPCEventAction* getEventAction() {
+		auto eventAction = dynamic_cast<OTPCEventAction*>(G4EventManager::GetEventManager()->GetUserEventAction());
+		if (!eventAction) {
+			std::cout << "Error: no event action to score deposits" << _endl_;
+			exit(1);
+		}
+		return eventAction;
+	}
+}
+
+OTPCProcessFilter::OTPCProcessFilter(std::vector<std::string> processNamesArg) :
+	processNames(std::move(processNamesArg)) {}
+
+void OTPCProcessFilter::resolve() {
+	processes.clear();
+	auto processTable = G4ProcessTable::GetProcessTable();
+	for (const auto& processName : processNames) {
+		// one process object per particle type
+		auto namedProcesses = processTable->FindProcesses(processName);
+		for (std::size_t i = 0; i < namedProcesses->entries(); i++) {
+			processes.push_back((*namedProcesses)[i]);
+		}
+		delete namedProcesses;
+	}
+	std::sort(processes.begin(), processes.end());
+	processes.erase(std::unique(processes.begin(), processes.end()), processes.end());
+	resolved = true;
+}
+
+bool OTPCProcessFilter::isResolved() const {
+	return resolved;
+}
+
+bool OTPCProcessFilter::contains(const G4VProcess* process) const {
+	return std::binary_search(processes.begin(), processes.end(), process);
+}
+
+OTPCScoringDetector::OTPCScoringDetector(const G4String& name) : G4VSensitiveDetector(name) {}
+
+OTPCCrystalSensitiveDetector::OTPCCrystalSensitiveDetector(const G4String& name, std::vector<G4int> crystalIndicesArg) :
+	OTPCScoringDetector(name),
+	crystalIndices(std::move(crystalIndicesArg)),
+	processFilter(scintillatorProcesses) {}
+
+void OTPCCrystalSensitiveDetector::Initialize(G4HCofThisEvent*) {
+	// first event of the thread, its physics list is built
+	if (!processFilter.isResolved()) {
+		processFilter.resolve();
+		eventAction = getEventAction();
+	}
+}
+
+G4bool OTPCCrystalSensitiveDetector::ProcessHits(G4Step* step, G4TouchableHistory*) {
+	G4double edep = step->GetTotalEnergyDeposit();
+	if (edep <= 0 || !processFilter.contains(step->GetPostStepPoint()->GetProcessDefinedStep())) {
+		return false;
+	}
+	// crystal is placed in its gamma detector volume, one level up
+	auto copyNumber = step->GetPreStepPoint()->GetTouchable()->GetCopyNumber(1);
+	eventAction->depositEnergyOnCrystal(crystalIndices[copyNumber], edep / keV);
+	return true;
+}
+
+void OTPCCrystalSensitiveDetector::depositTrack(const G4Track* track) {
+	auto copyNumber = track->GetTouchable()->GetCopyNumber(1);
+	eventAction->depositEnergyOnCrystal(crystalIndices[copyNumber], track->GetKineticEnergy() / keV);
+}
+
+OTPCGasSensitiveDetector::OTPCGasSensitiveDetector(const G4String& name, const OTPCRunConfiguration& config) :
+	OTPCScoringDetector(name),
+	runConfiguration(config),
+	processFilter(gasProcesses) {}
+
+void OTPCGasSensitiveDetector::Initialize(G4HCofThisEvent*) {
+	if (!processFilter.isResolved()) {
+		processFilter.resolve();
+		eventAction = getEventAction();
+	}
+}
+
+G4bool OTPCGasSensitiveDetector::ProcessHits(G4Step* step, G4TouchableHistory*) {
+	G4double edep = step->GetTotalEnergyDeposit();
+	if (edep <= 0 || !processFilter.contains(step->GetPostStepPoint()->GetProcessDefinedStep())) {
+		return false;
+	}
+	// step midpoint instead of a random point, replayed events must draw the same numbers
+	deposit(edep, (step->GetPreStepPoint()->GetPosition() + step->GetPostStepPoint()->GetPosition()) / 2);
+	return true;
+}
+
+void OTPCGasSensitiveDetector::depositTrack(const G4Track* track) {
+	deposit(track->GetKineticEnergy(), track->GetPosition());
+}
+
+void OTPCGasSensitiveDetector::deposit(G4double edep, const G4ThreeVector& position) {
+	eventAction->depositEnergyOnGas(edep / keV);
+	auto& voxelGrid = runConfiguration.getVoxelGrid();
+	if (voxelGrid.isEnabled()) {
+		auto voxel = voxelGrid.getIndex(position.x() / mm, position.y() / mm, position.z() / mm);
+		if (voxel >= 0) {
+			eventAction->depositEnergyOnVoxel(uint32_t(voxel), edep / keV);
+		}
+	}
+}
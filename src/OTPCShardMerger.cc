@@ -0,0 +1,140 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Per-worker output shards and their event-ordered merge
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCShardMerger.hh"
+#include "OTPCContainer.hh"
+
+#include <fstream>
+#include <iostream>
+#include <queue>
+#include <memory>
+#include <algorithm>
+#include <execution>
+#include <format>
+#include <cstring>
+
+namespace {
+	const std::string shardSuffix = ".shard";
+	const std::size_t streamBufferSize = 1 << 22;
+
+	struct ShardReader {
+		std::ifstream file;
+		std::vector<char> streamBuffer = std::vector<char>(streamBufferSize);
+		std::vector<char> payload;
+		const std::size_t recordSize; // 0 for records with uint16 size prefix, which is kept in the payload
+		uint64_t eventID = 0;
+
+		ShardReader(const std::filesystem::path& p, std::size_t recordSizeArg) : payload(recordSizeArg), recordSize(recordSizeArg) {
+			file.rdbuf()->pubsetbuf(streamBuffer.data(), streamBuffer.size());
+			file.open(p, std::ios_base::in | std::ios_base::binary);
+		}
+
+		bool next() {
+			file.read((char*)&eventID, sizeof(eventID));
+			if (recordSize == 0) {
+				uint16_t size = 0;
+				file.read((char*)&size, sizeof(size));
+				payload.resize(sizeof(size) + size);
+				std::memcpy(payload.data(), &size, sizeof(size));
+				file.read(payload.data() + sizeof(size), size);
+			}
+			else {
+				file.read(payload.data(), payload.size());
+			}
+			return bool(file);
+		}
+	};
+}
+
+std::filesystem::path shardFilePath(const std::filesystem::path& filePath, int64_t workerID) {
+	return filePath.string() + std::format("{}{}", shardSuffix, workerID);
+}
+
+std::vector<std::filesystem::path> findShards(const std::filesystem::path& filePath) {
+	std::vector<std::filesystem::path> shards;
+	auto directory = filePath.has_parent_path() ? filePath.parent_path() : std::filesystem::current_path();
+	auto prefix = filePath.filename().string() + shardSuffix;
+	if (!std::filesystem::exists(directory)) {
+		return shards;
+	}
+	for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+		if (entry.is_regular_file() && entry.path().filename().string().starts_with(prefix)) {
+			shards.push_back(entry.path());
+		}
+	}
+	std::sort(shards.begin(), shards.end());
+	return shards;
+}
+
+uint64_t mergeShards(const OTPCShardedFile& shardedFile, OTPCContainerWriter& container) {
+	auto shards = findShards(shardedFile.filePath);
+	if (shards.empty()) {
+		return 0;
+	}
+	auto recordSize = container.getSchema()[shardedFile.column].recordSize();
+
+	// every worker processes its events in increasing ID order, so a k-way merge of the shards is enough
+	std::vector<std::unique_ptr<ShardReader>> readers;
+	for (const auto& shard : shards) {
+		readers.push_back(std::make_unique<ShardReader>(shard, recordSize));
+	}
+	auto laterEvent = [&](std::size_t a, std::size_t b) {
+		return readers[a]->eventID > readers[b]->eventID;
+	};
+	std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(laterEvent)> queue(laterEvent);
+	for (std::size_t i = 0; i < readers.size(); i++) {
+		if (readers[i]->next()) {
+			queue.push(i);
+		}
+	}
+
+	// chunks are cut every eventsPerChunk events, so the chunks of all columns of an energy hold the same events
+	std::vector<char> chunk;
+	uint64_t
+		chunkFirstEvent = 0,
+		chunkLastEvent = 0,
+		chunkEvents = 0,
+		records = 0;
+	auto appendChunk = [&]() {
+		if (chunkEvents > 0) {
+			container.appendChunk(shardedFile.column, shardedFile.energy, chunkFirstEvent, chunkLastEvent, chunkEvents, chunk);
+		}
+		chunk.clear();
+		chunkEvents = 0;
+	};
+	while (!queue.empty()) {
+		auto i = queue.top();
+		queue.pop();
+		auto eventID = readers[i]->eventID;
+		if (chunkEvents == container.getEventsPerChunk()) {
+			appendChunk();
+		}
+		if (chunkEvents == 0) {
+			chunkFirstEvent = eventID;
+		}
+		chunkLastEvent = eventID;
+		chunk.insert(chunk.end(), readers[i]->payload.begin(), readers[i]->payload.end());
+		chunkEvents++;
+		records++;
+		if (readers[i]->next()) {
+			queue.push(i);
+		}
+	}
+	appendChunk();
+
+	readers.clear();
+	for (const auto& shard : shards) {
+		std::filesystem::remove(shard);
+	}
+	return records;
+}
+
+void mergeShards(const std::vector<OTPCShardedFile>& shardedFiles, OTPCContainerWriter& container) {
+	std::for_each(std::execution::par, shardedFiles.begin(), shardedFiles.end(), [&](const OTPCShardedFile& shardedFile) {
+		auto records = mergeShards(shardedFile, container);
+		std::cout << std::format("Merged {} events of {}\n", records, shardedFile.filePath.filename().string());
+	});
+}
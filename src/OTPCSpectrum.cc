@@ -0,0 +1,195 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Energy spectra of the gamma detectors
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCSpectrum.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <format>
+#include <cmath>
+#include <algorithm>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+OTPCHistogram::OTPCHistogram(double binWidthArg, double maximum) :
+	binWidth(binWidthArg),
+	counts(std::size_t(std::ceil(maximum / binWidthArg)), 0) {}
+
+void OTPCHistogram::fill(double value) {
+	auto bin = std::size_t(std::max(value, 0.) / binWidth);
+	if (bin < counts.size()) {
+		counts[bin]++;
+	}
+	else {
+		overflow++;
+	}
+}
+
+void OTPCHistogram::add(const OTPCHistogram& other) {
+	for (std::size_t bin = 0; bin < counts.size(); bin++) {
+		counts[bin] += other.counts[bin];
+	}
+	overflow += other.overflow;
+}
+
+void OTPCHistogram::clear() {
+	std::fill(counts.begin(), counts.end(), 0);
+	overflow = 0;
+}
+
+double OTPCHistogram::getBinWidth() const {
+	return binWidth;
+}
+
+const std::vector<uint64_t>& OTPCHistogram::getCounts() const {
+	return counts;
+}
+
+uint64_t OTPCHistogram::getOverflow() const {
+	return overflow;
+}
+
+void OTPCHistogram::write(std::ostream& stream) const {
+	uint64_t numberOfBins = counts.size();
+	stream.write((const char*)&binWidth, sizeof(binWidth));
+	stream.write((const char*)&numberOfBins, sizeof(numberOfBins));
+	stream.write((const char*)counts.data(), counts.size() * sizeof(uint64_t));
+	stream.write((const char*)&overflow, sizeof(overflow));
+}
+
+bool OTPCHistogram::read(std::istream& stream) {
+	uint64_t numberOfBins = 0;
+	stream.read((char*)&binWidth, sizeof(binWidth));
+	stream.read((char*)&numberOfBins, sizeof(numberOfBins));
+	// bins of a damaged record must not exhaust the memory
+	if (!stream || numberOfBins > (uint64_t(1) << 32)) {
+		return false;
+	}
+	counts.resize(numberOfBins);
+	stream.read((char*)counts.data(), counts.size() * sizeof(uint64_t));
+	stream.read((char*)&overflow, sizeof(overflow));
+	return bool(stream);
+}
+
+OTPCResolution OTPCResolution::forScintillator(const std::string& scintillator) {
+	if (scintillator == "CeBr3") {
+		return { 0, 1.0, 6e-5 };
+	}
+	if (scintillator == "LaBr3") {
+		return { 0, 0.45, 2.5e-5 };
+	}
+	std::cout << "No resolution known for " << scintillator << ", give it with --resolution" << _endl_;
+	exit(1);
+}
+
+OTPCResolution OTPCResolution::parse(const std::string& description) {
+	OTPCResolution resolution;
+	std::istringstream descriptionStream(description);
+	char separator1, separator2;
+	if (!(descriptionStream >> resolution.a >> separator1 >> resolution.b >> separator2 >> resolution.c) || separator1 != ',' || separator2 != ',') {
+		std::cout << "Resolution has to be given as a,b,c" << _endl_;
+		exit(1);
+	}
+	return resolution;
+}
+
+double OTPCResolution::sigma(double energy) const {
+	const double fwhmToSigma = 1 / (2 * std::sqrt(2 * std::log(2.)));
+	return std::sqrt(std::max(a + b * energy + c * energy * energy, 0.)) * fwhmToSigma;
+}
+
+void OTPCResolution::smear(std::span<const double> deposits, std::span<double> smeared, std::mt19937_64& generator) const {
+	// widths first in a branch-free loop the compiler vectorizes, then the draws for the hit crystals only
+	for (std::size_t i = 0; i < deposits.size(); i++) {
+		smeared[i] = sigma(deposits[i]);
+	}
+	std::normal_distribution<double> normal;
+	for (std::size_t i = 0; i < deposits.size(); i++) {
+		smeared[i] = deposits[i] > 0 ? deposits[i] + smeared[i] * normal(generator) : 0;
+	}
+}
+
+OTPCSpectra::OTPCSpectra(double binWidth, double maximum, double thresholdArg) :
+	threshold(thresholdArg),
+	sum(binWidth, maximum),
+	addback(binWidth, maximum)
+{
+	crystals.fill(OTPCHistogram(binWidth, maximum));
+}
+
+void OTPCSpectra::fillEvent(const double* deposits) {
+	eventCount++;
+	double eventSum = 0;
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		if (deposits[crystal] > threshold) {
+			crystals[crystal].fill(deposits[crystal]);
+			eventSum += deposits[crystal];
+		}
+	}
+	if (eventSum > 0) {
+		sum.fill(eventSum);
+	}
+	OTPCCrystalLayout::get().addback(deposits, threshold, clusters);
+	for (auto cluster : clusters) {
+		addback.fill(cluster);
+	}
+}
+
+void OTPCSpectra::add(const OTPCSpectra& other) {
+	eventCount += other.eventCount;
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		crystals[crystal].add(other.crystals[crystal]);
+	}
+	sum.add(other.sum);
+	addback.add(other.addback);
+}
+
+uint64_t OTPCSpectra::getEventCount() const {
+	return eventCount;
+}
+
+const OTPCHistogram& OTPCSpectra::getCrystal(std::size_t crystal) const {
+	return crystals[crystal];
+}
+
+const OTPCHistogram& OTPCSpectra::getSum() const {
+	return sum;
+}
+
+const OTPCHistogram& OTPCSpectra::getAddback() const {
+	return addback;
+}
+
+void OTPCSpectra::write(const std::filesystem::path& spectraPath) const {
+	std::ofstream spectraFile(spectraPath, std::ios_base::out | std::ios_base::trunc);
+	spectraFile << std::format("# events {}\n# energy_keV", eventCount);
+	for (std::size_t crystal = 0; crystal < numberOfCrystals; crystal++) {
+		spectraFile << "\tcrystal_" << crystal;
+	}
+	spectraFile << "\tsum\taddback\n";
+	// empty bins are left out, most of a spectrum is empty
+	std::string line;
+	for (std::size_t bin = 0; bin < sum.getCounts().size(); bin++) {
+		bool empty = sum.getCounts()[bin] == 0 && addback.getCounts()[bin] == 0;
+		line = std::format("{}", bin * sum.getBinWidth());
+		for (const auto& crystal : crystals) {
+			line += std::format("\t{}", crystal.getCounts()[bin]);
+			empty &= crystal.getCounts()[bin] == 0;
+		}
+		if (!empty) {
+			spectraFile << line << std::format("\t{}\t{}\n", sum.getCounts()[bin], addback.getCounts()[bin]);
+		}
+	}
+	if (!spectraFile) {
+		std::cout << "Cannot write " << spectraPath << _endl_;
+		exit(1);
+	}
+}
@@ -0,0 +1,71 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Applies the stacking rules to every new track
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCStackingAction.hh"
+#include "OTPCStackingRules.hh"
+#include "OTPCSensitiveDetector.hh"
+
+#include "G4Track.hh"
+#include "G4ParticleDefinition.hh"
+#include "G4LogicalVolume.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4SystemOfUnits.hh"
+#include <bit>
+
+OTPCStackingAction::OTPCStackingAction(const OTPCStackingRules& rulesArg, OTPCStackingCounters& countersArg) :
+	rules(rulesArg), counters(countersArg) {}
+
+G4ClassificationOfNewTrack OTPCStackingAction::ClassifyNewTrack(const G4Track* track) {
+	// primaries are stacked before they are located in the geometry, they have no volume yet
+	auto physicalVolume = track->GetVolume();
+	auto& volume = getVolumeRules(physicalVolume ? physicalVolume->GetLogicalVolume() : nullptr);
+	auto mask = getParticleRules(track->GetDefinition()) & volume.mask;
+	G4double energy = track->GetKineticEnergy() / keV;
+	for (; mask != 0; mask &= mask - 1) {
+		auto ruleIndex = std::countr_zero(mask);
+		auto& rule = rules.getRules()[ruleIndex];
+		if (energy < rule.minEnergy || energy >= rule.maxEnergy) {
+			continue;
+		}
+		counters.count(ruleIndex, energy);
+		switch (rule.action) {
+		case OTPCStackingRule::kill:
+			return fKill;
+		case OTPCStackingRule::deposit:
+			if (volume.detector) {
+				volume.detector->depositTrack(track);
+			}
+			return fKill;
+		case OTPCStackingRule::defer:
+			return fWaiting;
+		case OTPCStackingRule::track:
+			return fUrgent;
+		}
+	}
+	return fUrgent;
+}
+
+uint64_t OTPCStackingAction::getParticleRules(const G4ParticleDefinition* particle) {
+	// ions are created during the run, so definitions are looked up when they first appear
+	auto particleRule = particleRules.find(particle);
+	if (particleRule == particleRules.end()) {
+		particleRule = particleRules.emplace(particle, rules.getParticleMask(particle->GetParticleName(), particle->GetParticleType())).first;
+	}
+	return particleRule->second;
+}
+
+const OTPCStackingAction::VolumeRules& OTPCStackingAction::getVolumeRules(const G4LogicalVolume* volume) {
+	auto volumeRule = volumeRules.find(volume);
+	if (volumeRule == volumeRules.end()) {
+		VolumeRules volumeRules_i{ rules.getVolumeMask(""), nullptr };
+		if (volume) {
+			volumeRules_i.mask = rules.getVolumeMask(volume->GetName());
+			volumeRules_i.detector = dynamic_cast<OTPCScoringDetector*>(volume->GetSensitiveDetector());
+		}
+		volumeRule = volumeRules.emplace(volume, volumeRules_i).first;
+	}
+	return volumeRule->second;
+}
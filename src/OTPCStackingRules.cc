@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Rules of the stacking action
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCStackingRules.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <format>
+#include <algorithm>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+const std::array<std::string, 4> OTPCStackingRules::actionNames = { "kill", "deposit", "defer", "track" };
+
+void OTPCStackingRules::load(const std::filesystem::path& rulesPath) {
+	std::ifstream rulesFile(rulesPath);
+	if (!rulesFile.is_open()) {
+		std::cout << "Cannot open stacking rules " << rulesPath << _endl_;
+		exit(1);
+	}
+
+	std::string line;
+	while (std::getline(rulesFile, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream lineStream(line);
+		std::string actionName, particles, volume;
+		if (!(lineStream >> actionName)) {
+			continue;
+		}
+		if (!(lineStream >> particles >> volume)) {
+			std::cout << "Stacking rule needs an action, particles and a volume: " << line << _endl_;
+			exit(1);
+		}
+
+		OTPCStackingRule rule;
+		auto action = std::find(actionNames.begin(), actionNames.end(), actionName);
+		if (action == actionNames.end()) {
+			std::cout << "Unknown stacking action " << actionName << _endl_;
+			exit(1);
+		}
+		rule.action = OTPCStackingRule::Action(action - actionNames.begin());
+		if (particles != "*") {
+			std::istringstream particleStream(particles);
+			std::string particle;
+			while (std::getline(particleStream, particle, ',')) {
+				rule.particles.push_back(particle);
+			}
+		}
+		if (volume != "*") {
+			rule.volume = volume;
+		}
+		G4double minEnergy, maxEnergy;
+		if (lineStream >> minEnergy) {
+			if (!(lineStream >> maxEnergy) || minEnergy >= maxEnergy) {
+				std::cout << "Stacking rule needs an increasing energy range: " << line << _endl_;
+				exit(1);
+			}
+			rule.minEnergy = minEnergy;
+			rule.maxEnergy = maxEnergy;
+		}
+		rule.description = std::format("{} {} {} {} {}", actionName, particles, volume, rule.minEnergy, rule.maxEnergy);
+		rules.push_back(rule);
+	}
+	if (rules.size() > maxRules) {
+		std::cout << std::format("At most {} stacking rules", maxRules) << _endl_;
+		exit(1);
+	}
+	enabled = true;
+}
+
+bool OTPCStackingRules::isEnabled() const {
+	return enabled;
+}
+
+const std::vector<OTPCStackingRule>& OTPCStackingRules::getRules() const {
+	return rules;
+}
+
+uint64_t OTPCStackingRules::getParticleMask(const std::string& particleName, const std::string& particleType) const {
+	uint64_t mask = 0;
+	for (std::size_t ruleIndex = 0; ruleIndex < rules.size(); ruleIndex++) {
+		auto& particles = rules[ruleIndex].particles;
+		if (particles.empty() || std::any_of(particles.begin(), particles.end(), [&](const std::string& particle) {
+			return particle == particleName || particle == particleType;
+		})) {
+			mask |= uint64_t(1) << ruleIndex;
+		}
+	}
+	return mask;
+}
+
+uint64_t OTPCStackingRules::getVolumeMask(const std::string& volumeName) const {
+	uint64_t mask = 0;
+	for (std::size_t ruleIndex = 0; ruleIndex < rules.size(); ruleIndex++) {
+		if (rules[ruleIndex].volume.empty() || rules[ruleIndex].volume == volumeName) {
+			mask |= uint64_t(1) << ruleIndex;
+		}
+	}
+	return mask;
+}
+
+OTPCStackingCounters::OTPCStackingCounters(const G4String& name) : G4VAccumulable(name) {}
+
+void OTPCStackingCounters::resize(std::size_t numberOfRules) {
+	tracks.assign(numberOfRules, 0);
+	energies.assign(numberOfRules, 0);
+}
+
+void OTPCStackingCounters::count(std::size_t rule, G4double energy) {
+	tracks[rule]++;
+	energies[rule] += energy;
+}
+
+uint64_t OTPCStackingCounters::getTracks(std::size_t rule) const {
+	return tracks[rule];
+}
+
+G4double OTPCStackingCounters::getEnergy(std::size_t rule) const {
+	return energies[rule];
+}
+
+void OTPCStackingCounters::Merge(const G4VAccumulable& other) {
+	auto& otherCounters = static_cast<const OTPCStackingCounters&>(other);
+	if (tracks.size() < otherCounters.tracks.size()) {
+		tracks.resize(otherCounters.tracks.size(), 0);
+		energies.resize(otherCounters.energies.size(), 0);
+	}
+	for (std::size_t i = 0; i < otherCounters.tracks.size(); i++) {
+		tracks[i] += otherCounters.tracks[i];
+		energies[i] += otherCounters.energies[i];
+	}
+}
+
+void OTPCStackingCounters::Reset() {
+	std::fill(tracks.begin(), tracks.end(), 0);
+	std::fill(energies.begin(), energies.end(), 0);
+}
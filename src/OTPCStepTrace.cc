@@ -0,0 +1,270 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Step trace of selected events
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCStepTrace.hh"
+
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const char
+		headerMagic[8] = { 'O', 'T', 'P', 'C', 'S', 'T', 'P', '1' },
+		footerMagic[8] = { 'O', 'T', 'P', 'C', 'S', 'I', 'X', '1' };
+	const uint32_t traceVersion = 1;
+
+	static_assert(sizeof(OTPCStepRecord) == 16, "step records are stored as they are in memory");
+
+	template <typename T>
+	void writeValue(std::ostream& stream, const T& value) {
+		stream.write((const char*)&value, sizeof(value));
+	}
+
+	template <typename T>
+	T readValue(std::istream& stream) {
+		T value{};
+		stream.read((char*)&value, sizeof(value));
+		return value;
+	}
+
+	void writeNames(std::ostream& stream, const std::vector<std::string>& names) {
+		writeValue(stream, uint32_t(names.size()));
+		for (const auto& name : names) {
+			writeValue(stream, uint32_t(name.size()));
+			stream.write(name.data(), name.size());
+		}
+	}
+
+	void readNames(std::istream& stream, std::vector<std::string>& names) {
+		names.resize(readValue<uint32_t>(stream));
+		for (auto& name : names) {
+			name.resize(readValue<uint32_t>(stream));
+			stream.read(name.data(), name.size());
+		}
+	}
+
+	void writeFooter(std::ostream& stream, const std::vector<std::string>& processNames, const std::vector<std::string>& particleNames, const std::vector<OTPCTraceEntry>& events) {
+		uint64_t footerOffset = stream.tellp();
+		writeNames(stream, processNames);
+		writeNames(stream, particleNames);
+		writeValue(stream, uint64_t(events.size()));
+		for (const auto& event : events) {
+			writeValue(stream, event.event);
+			writeValue(stream, event.energy);
+			writeValue(stream, event.offset);
+			writeValue(stream, event.stepCount);
+		}
+		writeValue(stream, footerOffset);
+		stream.write(footerMagic, sizeof(footerMagic));
+	}
+
+	bool readTrace(std::istream& stream, std::vector<std::string>& processNames, std::vector<std::string>& particleNames, std::vector<OTPCTraceEntry>& events) {
+		char magic[sizeof(headerMagic)];
+		stream.read(magic, sizeof(magic));
+		if (!stream || std::memcmp(magic, headerMagic, sizeof(magic)) != 0 || readValue<uint32_t>(stream) != traceVersion) {
+			return false;
+		}
+		stream.seekg(-std::streamoff(sizeof(uint64_t) + sizeof(footerMagic)), std::ios_base::end);
+		auto footerOffset = readValue<uint64_t>(stream);
+		stream.read(magic, sizeof(magic));
+		if (!stream || std::memcmp(magic, footerMagic, sizeof(magic)) != 0) {
+			return false;
+		}
+		stream.seekg(footerOffset);
+		readNames(stream, processNames);
+		readNames(stream, particleNames);
+		events.resize(readValue<uint64_t>(stream));
+		for (auto& event : events) {
+			event.event = readValue<uint64_t>(stream);
+			event.energy = readValue<double>(stream);
+			event.offset = readValue<uint64_t>(stream);
+			event.stepCount = readValue<uint32_t>(stream);
+		}
+		return bool(stream);
+	}
+}
+
+OTPCNameTable& OTPCNameTable::getProcesses() {
+	static OTPCNameTable processes;
+	return processes;
+}
+
+OTPCNameTable& OTPCNameTable::getParticles() {
+	static OTPCNameTable particles;
+	return particles;
+}
+
+uint16_t OTPCNameTable::intern(const std::string& name) {
+	std::lock_guard lock(tableMutex);
+	auto [id, inserted] = ids.try_emplace(name, uint16_t(names.size()));
+	if (inserted) {
+		if (names.size() > std::numeric_limits<uint16_t>::max()) {
+			std::cout << "Too many distinct names in step trace" << _endl_;
+			exit(1);
+		}
+		names.push_back(name);
+	}
+	return id->second;
+}
+
+const std::string& OTPCNameTable::getName(uint16_t id) const {
+	std::lock_guard lock(tableMutex);
+	return names.at(id);
+}
+
+OTPCStepTraceWriter::OTPCStepTraceWriter(const std::filesystem::path& filePathArg) : filePath(filePathArg) {}
+
+OTPCStepTraceWriter::~OTPCStepTraceWriter() {
+	close();
+}
+
+void OTPCStepTraceWriter::open() {
+	if (std::filesystem::exists(filePath) && std::filesystem::file_size(filePath) > 0) {
+		file.open(filePath, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		if (!readTrace(file, processNames, particleNames, events)) {
+			std::cout << "Corrupted step trace " << filePath << ", restore it from a checkpoint or remove it" << _endl_;
+			exit(1);
+		}
+		for (std::size_t id = 0; id < processNames.size(); id++) {
+			processIDs[processNames[id]] = uint16_t(id);
+		}
+		for (std::size_t id = 0; id < particleNames.size(); id++) {
+			particleIDs[particleNames[id]] = uint16_t(id);
+		}
+		// the previous footer stays in place, so the file can be truncated back to it
+		file.seekp(0, std::ios_base::end);
+	}
+	else {
+		file.open(filePath, std::ios_base::in | std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+		if (!file.is_open()) {
+			std::cout << "Cannot create step trace " << filePath << _endl_;
+			exit(1);
+		}
+		file.write(headerMagic, sizeof(headerMagic));
+		writeValue(file, traceVersion);
+	}
+}
+
+uint16_t OTPCStepTraceWriter::intern(const std::string& name, std::vector<std::string>& names, std::unordered_map<std::string, uint16_t>& ids) {
+	auto [id, inserted] = ids.try_emplace(name, uint16_t(names.size()));
+	if (inserted) {
+		if (names.size() > std::numeric_limits<uint16_t>::max()) {
+			std::cout << "Too many distinct names in step trace" << _endl_;
+			exit(1);
+		}
+		names.push_back(name);
+	}
+	return id->second;
+}
+
+uint16_t OTPCStepTraceWriter::getFileID(uint16_t id, const OTPCNameTable& table, std::vector<uint16_t>& fileIDs, std::vector<std::string>& names, std::unordered_map<std::string, uint16_t>& ids) {
+	const uint16_t unknownID = std::numeric_limits<uint16_t>::max();
+	if (id >= fileIDs.size()) {
+		fileIDs.resize(std::size_t(id) + 1, unknownID);
+	}
+	// names are looked up only the first time an ID is written
+	if (fileIDs[id] == unknownID) {
+		fileIDs[id] = intern(table.getName(id), names, ids);
+	}
+	return fileIDs[id];
+}
+
+void OTPCStepTraceWriter::writeEvent(uint64_t eventNumber, double energy, const std::vector<OTPCStep>& steps) {
+	std::lock_guard lock(fileMutex);
+	if (!file.is_open()) {
+		open();
+	}
+	records.clear();
+	for (const auto& step : steps) {
+		records.push_back({ float(step.x), float(step.y), float(step.z),
+			getFileID(step.process, OTPCNameTable::getProcesses(), processFileIDs, processNames, processIDs),
+			getFileID(step.particle, OTPCNameTable::getParticles(), particleFileIDs, particleNames, particleIDs) });
+	}
+	appendRecords(eventNumber, energy);
+}
+
+void OTPCStepTraceWriter::appendRecords(uint64_t eventNumber, double energy) {
+	// one sequential write per event, the stream is positioned at the end of the file
+	OTPCTraceEntry entry{ eventNumber, energy, uint64_t(file.tellp()), uint32_t(records.size()) };
+	file.write((const char*)records.data(), records.size() * sizeof(OTPCStepRecord));
+	events.push_back(entry);
+}
+
+void OTPCStepTraceWriter::appendTrace(const std::filesystem::path& tracePath) {
+	OTPCStepTraceReader trace(tracePath);
+	for (const auto& event : trace.getEvents()) {
+		writeEvent(event.event, event.energy, trace.readSteps(event));
+	}
+}
+
+void OTPCStepTraceWriter::close() {
+	std::lock_guard lock(fileMutex);
+	if (!file.is_open()) {
+		return;
+	}
+	file.seekp(0, std::ios_base::end);
+	writeFooter(file, processNames, particleNames, events);
+	file.close();
+	if (!file) {
+		std::cout << "Writing of step trace " << filePath << " failed" << _endl_;
+		exit(1);
+	}
+}
+
+OTPCStepTraceReader::OTPCStepTraceReader(const std::filesystem::path& filePathArg) : filePath(filePathArg) {
+	file.open(filePath, std::ios_base::in | std::ios_base::binary);
+	if (!file.is_open() || !readTrace(file, processNames, particleNames, events)) {
+		std::cout << "Cannot read step trace " << filePath << _endl_;
+		exit(1);
+	}
+}
+
+const std::vector<OTPCTraceEntry>& OTPCStepTraceReader::getEvents() const {
+	return events;
+}
+
+std::size_t OTPCStepTraceReader::findEvent(uint64_t eventNumber, double energy) const {
+	auto event = std::find_if(events.begin(), events.end(), [&](const OTPCTraceEntry& entry) {
+		return entry.event == eventNumber && entry.energy == energy;
+	});
+	return event - events.begin();
+}
+
+const std::string& OTPCStepTraceReader::getProcessName(uint16_t id) const {
+	return processNames.at(id);
+}
+
+const std::string& OTPCStepTraceReader::getParticleName(uint16_t id) const {
+	return particleNames.at(id);
+}
+
+std::vector<OTPCStepRecord> OTPCStepTraceReader::readRecords(const OTPCTraceEntry& entry) {
+	std::vector<OTPCStepRecord> records(entry.stepCount);
+	file.seekg(entry.offset);
+	file.read((char*)records.data(), records.size() * sizeof(OTPCStepRecord));
+	if (!file) {
+		std::cout << "Cannot read steps of event " << entry.event << " from " << filePath << _endl_;
+		exit(1);
+	}
+	return records;
+}
+
+std::vector<OTPCStep> OTPCStepTraceReader::readSteps(const OTPCTraceEntry& entry) {
+	std::vector<OTPCStep> steps;
+	for (const auto& record : readRecords(entry)) {
+		steps.push_back({ record.x, record.y, record.z,
+			OTPCNameTable::getProcesses().intern(getProcessName(record.process)),
+			OTPCNameTable::getParticles().intern(getParticleName(record.particle)) });
+	}
+	return steps;
+}
@@ -12,26 +12,20 @@
 //
 //  V.Guadilla 2019
 //
-//  Collect the energy deposited in the sensitive OTPC volume
+//  Trace the steps of replayed events, deposits are scored by OTPCSensitiveDetector
 ///////////////////////////////////////////////////////////////////
 
 #include "OTPCSteppingAction.hh"
 #include "OTPCEventAction.hh"
+#include "OTPCRunConfiguration.hh"
+#include "OTPCStepTrace.hh"
 #include "G4SteppingManager.hh"
 #include "G4RadioactiveDecay.hh"
 #include "G4DynamicParticle.hh"
 
 #include "G4SystemOfUnits.hh"
-#include <format>
-#include <set>
 
-OTPCSteppingAction::OTPCSteppingAction(OTPCEventAction* EvAct, const std::string& scintName) :eventAction(EvAct), scintilatorType(scintName) {}
-
-OTPCSteppingAction::~OTPCSteppingAction() {
-	for (auto [p, c] : dcs) {
-		std::cout << std::format("{}\t{}\n", p, c);
-	}
-}
+OTPCSteppingAction::OTPCSteppingAction(OTPCEventAction* EvAct, const OTPCRunConfiguration& config) :eventAction(EvAct), runConfiguration(config) {}
 
 inline std::string filename_string(std::string path_str) {
 	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
@@ -40,63 +34,37 @@ inline std::string filename_string(std::string path_str) {
 #define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
 #define checkpoint std::cout << "checkpoint" << _endl_
 
-std::vector<std::string>
-scintillatorProcesses = { "compt", "eBrem", "msc", "phot", "eIoni", "UserMaxStep" },
-gasProcesses = { "eIoni", "hIoni", "UserMaxStep" };
-
 void OTPCSteppingAction::UserSteppingAction(const G4Step* aStep)
 {
 
-	G4double edep = aStep->GetTotalEnergyDeposit();
-
-	G4StepPoint* prePoint = aStep->GetPreStepPoint();
 	G4StepPoint* postPoint = aStep->GetPostStepPoint();
-	G4TouchableHandle touch = prePoint->GetTouchableHandle();
-	const std::string currentMaterialName = touch->GetVolume()->GetLogicalVolume()->GetMaterial()->GetName();
 	const G4VProcess* process = postPoint->GetProcessDefinedStep();
-	std::string processName = process->GetProcessName();
-	auto track = aStep->GetTrack();
-	G4int begin;
 
-	G4String nameP = track->GetDefinition()->GetParticleName();
-
-	if (false && process) {
-		//if (edep>0.0 & currentMaterialName == "GasOTPC" & nameP=="alpha"){
-		//if (edep > 0.0 & currentMaterialName == "GasOTPC") {
-			//
-
-		auto prePos = prePoint->GetPosition();
+	// full step detail of replayed events; no random numbers may be drawn here, the replay would diverge from production
+	if (runConfiguration.isStepCapture() && process) {
+		auto& processID = getProcessID(process);
+		if (processID.decay) {
+			eventAction->setDecay();
+		}
 		auto postPos = postPoint->GetPosition();
-		auto deltaPos = postPos - prePos;
-		auto pos = prePos + G4UniformRand() * deltaPos; // position randomization simplified
-
-
-		//eventAction->addProcess(x / mm, y / mm, z / mm, processName + '\t' + nameP);
-		eventAction->addEdep(edep / keV, pos.x() / mm, pos.y() / mm, pos.z() / mm);
-		//G4cout<<edep/keV<<"    "<<x/mm<<"    "<<y/mm<<"    "<<z/mm<<G4endl;
+		eventAction->addProcess(postPos.x() / mm, postPos.y() / mm, postPos.z() / mm, processID.id, getParticleID(aStep->GetTrack()->GetDefinition()));
 	}
+}
 
-	if (edep > 0.0) {
-		if (currentMaterialName == scintilatorType && std::find(scintillatorProcesses.begin(), scintillatorProcesses.end(), processName) != scintillatorProcesses.end()) {
-			G4int nCrystal = touch->GetCopyNumber(1); //N will be the number of levels up, we have to check it to pickup the index of CeBr3 crystal
-			eventAction->depositEnergyOnCrystal(nCrystal, edep / keV);
-		}
-		else if (currentMaterialName == "GasOTPC" && std::find(gasProcesses.begin(), gasProcesses.end(), processName) != gasProcesses.end()) {
-			eventAction->depositEnergyOnGas(edep / keV);
-		}
+const OTPCSteppingAction::ProcessID& OTPCSteppingAction::getProcessID(const G4VProcess* process) {
+	// names are interned only for the first step of every process of the thread
+	auto processID = processIDs.find(process);
+	if (processID == processIDs.end()) {
+		auto& processName = process->GetProcessName();
+		processID = processIDs.emplace(process, ProcessID{ OTPCNameTable::getProcesses().intern(processName), processName == "RadioactiveDecay" }).first;
 	}
+	return processID->second;
+}
 
-	//if (currentMaterialName == scintilatorType) {
-	if (false && processName == "RadioactiveDecay") {
-		//std::cout << nameP << '\n';
-		if (track->GetParentID() != 0) {
-
-			dcs[nameP]++;
-			if (nameP == "La138") {
-				eventAction->setFlag();
-			}
-		}
+uint16_t OTPCSteppingAction::getParticleID(const G4ParticleDefinition* particle) {
+	auto particleID = particleIDs.find(particle);
+	if (particleID == particleIDs.end()) {
+		particleID = particleIDs.emplace(particle, OTPCNameTable::getParticles().intern(particle->GetParticleName())).first;
 	}
+	return particleID->second;
 }
-
-
@@ -0,0 +1,254 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Job queue on a shared directory for sweeps over detector configurations
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCSweepQueue.hh"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <map>
+#include <random>
+#include <thread>
+#include <future>
+#include <format>
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <sys/wait.h>
+#endif
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const std::string unitExtension = ".args";
+
+	std::string workerName() {
+		for (auto variable : { "HOSTNAME", "COMPUTERNAME" }) {
+			if (auto value = std::getenv(variable)) {
+				return value;
+			}
+		}
+		return "unknown";
+	}
+
+	void touch(const std::filesystem::path& p) {
+		std::ofstream(p, std::ios_base::app).close();
+		std::error_code errorCode;
+		std::filesystem::last_write_time(p, std::filesystem::file_time_type::clock::now(), errorCode);
+	}
+}
+
+OTPCSweepQueue::OTPCSweepQueue(std::filesystem::path queuePathArg, std::chrono::seconds leaseDurationArg) :
+	queuePath(queuePathArg),
+	unitsPath(queuePathArg / "units"),
+	leasesPath(queuePathArg / "leases"),
+	donePath(queuePathArg / "done"),
+	failedPath(queuePathArg / "failed"),
+	leaseDuration(leaseDurationArg)
+{
+	for (const auto& p : { unitsPath, leasesPath, donePath, failedPath }) {
+		std::filesystem::create_directories(p);
+	}
+}
+
+uint64_t OTPCSweepQueue::enqueuePlan(const std::filesystem::path& planPath, uint64_t baseSeed) {
+	std::ifstream planFile(planPath);
+	if (!planFile.is_open()) {
+		std::cout << "Cannot open sweep plan " << planPath << _endl_;
+		exit(1);
+	}
+
+	// option name -> values, options with one value are passed to every unit
+	std::vector<std::pair<std::string, std::vector<std::string>>> axes;
+	std::string line;
+	while (std::getline(planFile, line)) {
+		line = line.substr(0, line.find('#'));
+		auto separator = line.find('=');
+		if (separator == std::string::npos) {
+			continue;
+		}
+		std::istringstream nameStream(line.substr(0, separator)), valueStream(line.substr(separator + 1));
+		std::string name, value;
+		nameStream >> name;
+		std::vector<std::string> values;
+		while (valueStream >> value) {
+			values.push_back(value);
+		}
+		if (name.empty() || values.empty()) {
+			continue;
+		}
+		if (name == "seed") {
+			std::cout << "Seeds are allocated per unit by the queue" << _endl_;
+			continue;
+		}
+		axes.emplace_back(name, values);
+	}
+
+	// units are numbered after the ones already queued, plans are expected to be enqueued from one place
+	uint64_t firstUnit = std::distance(std::filesystem::directory_iterator(unitsPath), std::filesystem::directory_iterator());
+
+	uint64_t numberOfUnits = 1;
+	for (const auto& [name, values] : axes) {
+		numberOfUnits *= values.size();
+	}
+	for (uint64_t unit = 0; unit < numberOfUnits; unit++) {
+		std::string arguments;
+		auto remainder = unit;
+		for (const auto& [name, values] : axes) {
+			arguments += std::format("--{} {} ", name, values[remainder % values.size()]);
+			remainder /= values.size();
+		}
+		auto unitIndex = firstUnit + unit;
+		// every unit gets its own seed so that units of one sweep are statistically independent
+		arguments += std::format("--seed {}", baseSeed + unitIndex);
+		auto unitFilePath = unitsPath / std::format("unit_{:06}{}", unitIndex, unitExtension);
+		std::ofstream unitFile(unitFilePath);
+		unitFile << arguments << '\n';
+		std::cout << std::format("{}: {}\n", unitFilePath.filename().string(), arguments);
+	}
+	return numberOfUnits;
+}
+
+uint64_t OTPCSweepQueue::drain(const std::string& executable, const std::string& forwardedArguments) {
+	while (true) {
+		std::vector<std::string> unitNames;
+		for (const auto& entry : std::filesystem::directory_iterator(unitsPath)) {
+			if (entry.path().extension() == unitExtension) {
+				unitNames.push_back(entry.path().stem().string());
+			}
+		}
+		std::sort(unitNames.begin(), unitNames.end());
+
+		uint64_t finishedUnits = 0, failedUnits = 0;
+		bool claimed = false;
+		for (const auto& unitName : unitNames) {
+			if (std::filesystem::exists(donePath / unitName)) {
+				finishedUnits++;
+				continue;
+			}
+			if (std::filesystem::exists(failedPath / unitName)) {
+				finishedUnits++;
+				failedUnits++;
+				continue;
+			}
+			std::filesystem::path leasePath;
+			if (!tryClaim(unitName, leasePath)) {
+				continue;
+			}
+			// another worker may have finished the unit and released its lease since the check above
+			if (std::filesystem::exists(donePath / unitName) || std::filesystem::exists(failedPath / unitName)) {
+				release(unitName, leasePath);
+				claimed = true;
+				break;
+			}
+			std::ifstream unitFile(unitsPath / (unitName + unitExtension));
+			std::string arguments;
+			std::getline(unitFile, arguments);
+			auto command = std::format("\"{}\" {} {}", executable, arguments, forwardedArguments);
+			auto status = runUnit(unitName, leasePath, command);
+			std::ofstream(status == 0 ? donePath / unitName : failedPath / unitName) << std::format("{} {}\n", workerName(), status);
+			release(unitName, leasePath);
+			claimed = true;
+			break; // rescan, other workers may have finished units meanwhile
+		}
+		if (claimed) {
+			continue;
+		}
+		if (finishedUnits == unitNames.size()) {
+			std::cout << std::format("Queue drained: {} units, {} failed\n", unitNames.size(), failedUnits);
+			return failedUnits;
+		}
+		// remaining units are leased by other workers, wait for them to finish or expire
+		std::this_thread::sleep_for(std::clamp<std::chrono::seconds>(leaseDuration / 4, std::chrono::seconds(1), std::chrono::seconds(30)));
+	}
+}
+
+int64_t OTPCSweepQueue::getGeneration(const std::string& unitName, const std::filesystem::path& leasePath) {
+	auto leaseName = leasePath.filename().string();
+	int64_t generation = -1;
+	if (leaseName.size() > unitName.size() && leaseName.starts_with(unitName) && leaseName[unitName.size()] == '.') {
+		auto result = std::from_chars(leaseName.data() + unitName.size() + 1, leaseName.data() + leaseName.size(), generation);
+		if (result.ec != std::errc() || result.ptr != leaseName.data() + leaseName.size()) {
+			return -1;
+		}
+	}
+	return generation;
+}
+
+bool OTPCSweepQueue::tryClaim(const std::string& unitName, std::filesystem::path& leasePath) {
+	// leases of a unit are numbered by generation, the highest one is the current lease
+	auto leasePrefix = unitName + '.';
+	int64_t generation = -1;
+	for (const auto& entry : std::filesystem::directory_iterator(leasesPath)) {
+		generation = std::max(generation, getGeneration(unitName, entry.path()));
+	}
+	if (generation >= 0 && !isLeaseExpired(leasesPath / std::format("{}{}", leasePrefix, generation))) {
+		return false;
+	}
+	// create_directory is atomic, of the workers seeing the same lease expired only one creates the next generation;
+	// expired generations are kept until the unit is finished, so a worker with an outdated listing cannot create them again
+	leasePath = leasesPath / std::format("{}{}", leasePrefix, generation + 1);
+	std::error_code errorCode;
+	if (!std::filesystem::create_directory(leasePath, errorCode)) {
+		return false;
+	}
+	std::ofstream(leasePath / "owner") << workerName() << '\n';
+	if (generation >= 0) {
+		std::cout << std::format("Lease of {} expired, re-queued\n", unitName);
+	}
+	return true;
+}
+
+void OTPCSweepQueue::release(const std::string& unitName, const std::filesystem::path& leasePath) {
+	// own lease and the expired ones before it, a newer lease belongs to a worker that took the unit over
+	auto ownGeneration = getGeneration(unitName, leasePath);
+	std::vector<std::filesystem::path> releasedPaths;
+	for (const auto& entry : std::filesystem::directory_iterator(leasesPath)) {
+		auto generation = getGeneration(unitName, entry.path());
+		if (generation >= 0 && generation <= ownGeneration) {
+			releasedPaths.push_back(entry.path());
+		}
+	}
+	std::error_code errorCode;
+	for (const auto& releasedPath : releasedPaths) {
+		std::filesystem::remove_all(releasedPath, errorCode);
+	}
+}
+
+bool OTPCSweepQueue::isLeaseExpired(const std::filesystem::path& leasePath) {
+	std::error_code errorCode;
+	auto heartbeatPath = leasePath / "owner";
+	auto lastHeartbeat = std::filesystem::last_write_time(std::filesystem::exists(heartbeatPath) ? heartbeatPath : leasePath, errorCode);
+	if (errorCode) {
+		return false; // lease removed meanwhile, unit is done or failed
+	}
+	return std::filesystem::file_time_type::clock::now() - lastHeartbeat > leaseDuration;
+}
+
+int OTPCSweepQueue::runUnit(const std::string& unitName, const std::filesystem::path& leasePath, const std::string& command) {
+	std::cout << std::format("Running {}: {}\n", unitName, command);
+	auto unitRun = std::async(std::launch::async, [&] {
+		return std::system(command.c_str());
+	});
+	// heartbeat keeps the lease alive while the unit runs
+	auto heartbeatPeriod = std::max<std::chrono::seconds>(leaseDuration / 4, std::chrono::seconds(1));
+	while (unitRun.wait_for(heartbeatPeriod) != std::future_status::ready) {
+		touch(leasePath / "owner");
+	}
+	auto status = unitRun.get();
+#ifdef __linux__
+	if (status != -1 && WIFEXITED(status)) {
+		status = WEXITSTATUS(status);
+	}
+#endif
+	return status;
+}
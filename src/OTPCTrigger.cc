@@ -0,0 +1,149 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Online trigger deciding at the end of event whether it is written
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCTrigger.hh"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <format>
+#include <algorithm>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+const std::array<std::string, OTPCTrigger::numberOfConditions> OTPCTrigger::conditionNames = { "multiplicity", "gas", "sum" };
+
+void OTPCTrigger::load(const std::filesystem::path& triggerPath) {
+	std::ifstream triggerFile(triggerPath);
+	if (!triggerFile.is_open()) {
+		std::cout << "Cannot open trigger file " << triggerPath << _endl_;
+		exit(1);
+	}
+
+	std::string line;
+	while (std::getline(triggerFile, line)) {
+		line = line.substr(0, line.find('#'));
+		auto separator = line.find('=');
+		if (separator == std::string::npos) {
+			continue;
+		}
+		std::istringstream nameStream(line.substr(0, separator)), valueStream(line.substr(separator + 1));
+		std::string name;
+		nameStream >> name;
+		std::vector<G4double> values;
+		G4double value;
+		while (valueStream >> value) {
+			values.push_back(value);
+		}
+		auto expectValues = [&](std::size_t count) {
+			if (values.size() != count) {
+				std::cout << std::format("Trigger condition {} needs {} values", name, count) << _endl_;
+				exit(1);
+			}
+		};
+
+		if (name == "threshold") {
+			expectValues(1);
+			std::size_t crystal;
+			if (nameStream >> crystal) {
+				if (crystal >= thresholds.size()) {
+					std::cout << "No crystal " << crystal << _endl_;
+					exit(1);
+				}
+				thresholds[crystal] = values[0];
+			}
+			else {
+				thresholds.fill(values[0]);
+			}
+		}
+		else if (name == "multiplicity") {
+			expectValues(2);
+			minMultiplicity = G4int(values[0]);
+			maxMultiplicity = G4int(values[1]);
+		}
+		else if (name == "gas") {
+			expectValues(2);
+			minGas = values[0];
+			maxGas = values[1];
+		}
+		else if (name == "sum") {
+			expectValues(2);
+			minSum = values[0];
+			maxSum = values[1];
+		}
+		else if (name == "prescale") {
+			expectValues(1);
+			prescale = uint64_t(values[0]);
+		}
+		else {
+			std::cout << "Unknown trigger condition " << name << _endl_;
+			exit(1);
+		}
+	}
+	enabled = true;
+}
+
+bool OTPCTrigger::isEnabled() const {
+	return enabled;
+}
+
+uint8_t OTPCTrigger::evaluate(const std::array<G4double, 20>& crystalDeposits, G4double gasDeposit) const {
+	G4int multiplicity = 0;
+	G4double sum = 0;
+	for (std::size_t crystal = 0; crystal < crystalDeposits.size(); crystal++) {
+		multiplicity += crystalDeposits[crystal] > thresholds[crystal];
+		sum += crystalDeposits[crystal];
+	}
+	uint8_t failed = 0;
+	if (multiplicity < minMultiplicity || multiplicity > maxMultiplicity) {
+		failed |= multiplicityCondition;
+	}
+	if (gasDeposit < minGas || gasDeposit > maxGas) {
+		failed |= gasCondition;
+	}
+	if (sum < minSum || sum > maxSum) {
+		failed |= sumCondition;
+	}
+	return failed;
+}
+
+bool OTPCTrigger::isPrescaled(uint64_t eventNumber) const {
+	// by event number rather than by a counter, so the sample does not depend on the number of threads
+	return prescale > 0 && eventNumber % prescale == 0;
+}
+
+OTPCTriggerCounters::OTPCTriggerCounters(const G4String& name) : G4VAccumulable(name) {}
+
+void OTPCTriggerCounters::resize(std::size_t numberOfEnergyPoints) {
+	counts.assign(numberOfEnergyPoints * countersPerEnergy, 0);
+}
+
+void OTPCTriggerCounters::count(std::size_t energyIndex, std::size_t counter) {
+	counts[energyIndex * countersPerEnergy + counter]++;
+}
+
+uint64_t OTPCTriggerCounters::get(std::size_t energyIndex, std::size_t counter) const {
+	return counts[energyIndex * countersPerEnergy + counter];
+}
+
+void OTPCTriggerCounters::Merge(const G4VAccumulable& other) {
+	auto& otherCounts = static_cast<const OTPCTriggerCounters&>(other).counts;
+	if (counts.size() < otherCounts.size()) {
+		counts.resize(otherCounts.size(), 0);
+	}
+	for (std::size_t i = 0; i < otherCounts.size(); i++) {
+		counts[i] += otherCounts[i];
+	}
+}
+
+void OTPCTriggerCounters::Reset() {
+	std::fill(counts.begin(), counts.end(), 0);
+}
@@ -0,0 +1,374 @@
+/////////////////////////////////////////////////////////////////////////
+//
+// Gas deposits on a fixed voxel grid
+//
+/////////////////////////////////////////////////////////////////////////
+
+#include "OTPCVoxel.hh"
+
+#include <zlib.h>
+
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <mutex>
+#include <format>
+
+inline std::string filename_string(std::string path_str) {
+	return path_str.substr(path_str.rfind("\\") + 1, path_str.size() - path_str.rfind("\\") - 1);
+};
+
+#define _endl_ " (" << filename_string(__FILE__) << "; " << __LINE__ << ")" << '\n'
+
+namespace {
+	const char
+		headerMagic[8] = { 'O', 'T', 'P', 'C', 'V', 'O', 'X', '1' },
+		blockMagic[4] = { 'V', 'B', 'L', 'K' };
+	const uint32_t voxelVersion = 1;
+	const int compressionLevel = 1;
+	const std::size_t blockHeaderSize = sizeof(blockMagic) + sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+	// part numbers are chosen under this lock, threads of a process never pick the same file
+	std::mutex partMutex;
+
+	template <typename T>
+	void writeValue(std::ostream& stream, const T& value) {
+		stream.write((const char*)&value, sizeof(value));
+	}
+
+	template <typename T>
+	T readValue(std::istream& stream) {
+		T value{};
+		stream.read((char*)&value, sizeof(value));
+		return value;
+	}
+
+	template <typename T>
+	void appendValue(std::vector<char>& data, const T& value) {
+		data.insert(data.end(), (const char*)&value, (const char*)&value + sizeof(value));
+	}
+
+	template <typename T>
+	void appendValues(std::vector<char>& data, const T* values, std::size_t count) {
+		data.insert(data.end(), (const char*)values, (const char*)(values + count));
+	}
+
+	template <typename T>
+	bool takeValues(const std::vector<char>& data, std::size_t& position, T* values, std::size_t count) {
+		if (data.size() - position < count * sizeof(T)) {
+			return false;
+		}
+		std::memcpy(values, data.data() + position, count * sizeof(T));
+		position += count * sizeof(T);
+		return true;
+	}
+}
+
+OTPCVoxelGrid::OTPCVoxelGrid(std::array<uint32_t, 3> shapeArg, std::array<double, 3> lowerArg, std::array<double, 3> upperArg, double stepArg) :
+	shape(shapeArg),
+	lower(lowerArg),
+	upper(upperArg),
+	step(stepArg)
+{
+	if (getNumberOfVoxels() == 0 || getNumberOfVoxels() > UINT32_MAX || step <= 0) {
+		std::cout << "Voxel grid needs 1 to 2^32 voxels and a positive deposit step" << _endl_;
+		exit(1);
+	}
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		inverseVoxelSize[axis] = shape[axis] / (upper[axis] - lower[axis]);
+	}
+}
+
+std::array<uint32_t, 3> OTPCVoxelGrid::parseShape(const std::string& description) {
+	std::array<uint32_t, 3> shape;
+	std::istringstream descriptionStream(description);
+	char separator1, separator2;
+	if (!(descriptionStream >> shape[0] >> separator1 >> shape[1] >> separator2 >> shape[2]) || separator1 != ',' || separator2 != ',') {
+		std::cout << "Voxel grid has to be given as nx,ny,nz" << _endl_;
+		exit(1);
+	}
+	return shape;
+}
+
+bool OTPCVoxelGrid::isEnabled() const {
+	return getNumberOfVoxels() > 0;
+}
+
+const std::array<uint32_t, 3>& OTPCVoxelGrid::getShape() const {
+	return shape;
+}
+
+const std::array<double, 3>& OTPCVoxelGrid::getLower() const {
+	return lower;
+}
+
+const std::array<double, 3>& OTPCVoxelGrid::getUpper() const {
+	return upper;
+}
+
+double OTPCVoxelGrid::getStep() const {
+	return step;
+}
+
+uint64_t OTPCVoxelGrid::getNumberOfVoxels() const {
+	return uint64_t(shape[0]) * shape[1] * shape[2];
+}
+
+int64_t OTPCVoxelGrid::getIndex(double x, double y, double z) const {
+	std::array<double, 3> point = { x, y, z };
+	int64_t index = 0;
+	for (std::size_t axis = 0; axis < 3; axis++) {
+		auto bin = std::floor((point[axis] - lower[axis]) * inverseVoxelSize[axis]);
+		if (bin < 0 || bin >= shape[axis]) {
+			return -1;
+		}
+		index = index * shape[axis] + int64_t(bin);
+	}
+	return index;
+}
+
+OTPCVoxelWriter::OTPCVoxelWriter(std::filesystem::path filePrefixArg, const OTPCVoxelGrid& gridArg, std::vector<std::string> labelNamesArg,
+	uint64_t maxFileSizeArg, uint32_t eventsPerBlockArg) :
+	filePrefix(filePrefixArg),
+	grid(gridArg),
+	labelNames(labelNamesArg),
+	maxFileSize(maxFileSizeArg),
+	eventsPerBlock(eventsPerBlockArg) {}
+
+OTPCVoxelWriter::~OTPCVoxelWriter() {
+	close();
+}
+
+void OTPCVoxelWriter::writeEvent(uint64_t eventNumber, double energy, std::span<const double> labels, std::vector<std::pair<uint32_t, double>>& deposits) {
+	if (labels.size() != labelNames.size()) {
+		std::cout << std::format("Voxel event has {} labels instead of {}", labels.size(), labelNames.size()) << _endl_;
+		exit(1);
+	}
+	// steps of a track mostly come in voxel order already
+	std::sort(deposits.begin(), deposits.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	indices.clear();
+	values.clear();
+	uint32_t previousVoxel = 0;
+	for (std::size_t i = 0; i < deposits.size();) {
+		auto voxel = deposits[i].first;
+		double deposit = 0;
+		for (; i < deposits.size() && deposits[i].first == voxel; i++) {
+			deposit += deposits[i].second;
+		}
+		auto value = std::min(std::round(deposit / grid.getStep()), 65535.);
+		if (value >= 1) {
+			// differences to the previous voxel (the first one from 0) compress well
+			indices.push_back(voxel - previousVoxel);
+			values.push_back(uint16_t(value));
+			previousVoxel = voxel;
+		}
+	}
+	appendValue(block, eventNumber);
+	appendValue(block, energy);
+	for (auto label : labels) {
+		appendValue(block, float(label));
+	}
+	appendValue(block, uint32_t(indices.size()));
+	appendValues(block, indices.data(), indices.size());
+	appendValues(block, values.data(), values.size());
+	if (++blockEvents == eventsPerBlock) {
+		flushBlock();
+	}
+}
+
+const std::filesystem::path& OTPCVoxelWriter::getFilePrefix() const {
+	return filePrefix;
+}
+
+void OTPCVoxelWriter::flush() {
+	flushBlock();
+	if (file.is_open()) {
+		file.flush();
+		if (!file) {
+			std::cout << "Cannot write voxel file " << filePrefix << _endl_;
+			exit(1);
+		}
+	}
+}
+
+void OTPCVoxelWriter::close() {
+	flushBlock();
+	if (file.is_open()) {
+		file.close();
+		if (!file) {
+			std::cout << "Cannot write voxel file " << filePrefix << _endl_;
+			exit(1);
+		}
+	}
+}
+
+void OTPCVoxelWriter::openPart() {
+	std::filesystem::path filePath;
+	{
+		std::lock_guard lock(partMutex);
+		for (uint64_t part = 0;; part++) {
+			filePath = filePrefix;
+			filePath += std::format("_{:04}.vox", part);
+			if (!std::filesystem::exists(filePath)) {
+				break;
+			}
+		}
+		file.open(filePath, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	}
+	if (!file.is_open()) {
+		std::cout << "Cannot create voxel file " << filePath << _endl_;
+		exit(1);
+	}
+	file.write(headerMagic, sizeof(headerMagic));
+	writeValue(file, voxelVersion);
+	for (auto size : grid.getShape()) {
+		writeValue(file, size);
+	}
+	for (auto corner : { grid.getLower(), grid.getUpper() }) {
+		for (auto coordinate : corner) {
+			writeValue(file, coordinate);
+		}
+	}
+	writeValue(file, grid.getStep());
+	writeValue(file, uint32_t(labelNames.size()));
+	fileSize = sizeof(headerMagic) + sizeof(uint32_t) * 5 + sizeof(double) * 7;
+	for (const auto& labelName : labelNames) {
+		writeValue(file, uint16_t(labelName.size()));
+		file.write(labelName.data(), labelName.size());
+		fileSize += sizeof(uint16_t) + labelName.size();
+	}
+}
+
+void OTPCVoxelWriter::flushBlock() {
+	if (blockEvents == 0) {
+		return;
+	}
+	if (!file.is_open()) {
+		openPart();
+	}
+	uLongf compressedSize = compressBound(uLong(block.size()));
+	std::vector<char> compressed(compressedSize);
+	if (compress2((Bytef*)compressed.data(), &compressedSize, (const Bytef*)block.data(), uLong(block.size()), compressionLevel) != Z_OK) {
+		std::cout << "Cannot compress voxel block" << _endl_;
+		exit(1);
+	}
+	file.write(blockMagic, sizeof(blockMagic));
+	writeValue(file, blockEvents);
+	writeValue(file, uint64_t(block.size()));
+	writeValue(file, uint64_t(compressedSize));
+	writeValue(file, uint32_t(crc32(0, (const Bytef*)block.data(), uInt(block.size()))));
+	file.write(compressed.data(), compressedSize);
+	fileSize += blockHeaderSize + compressedSize;
+	block.clear();
+	blockEvents = 0;
+	if (fileSize >= maxFileSize) {
+		close();
+	}
+}
+
+void OTPCVoxelEvent::toDense(const OTPCVoxelGrid& grid, std::vector<float>& tensor) const {
+	tensor.assign(grid.getNumberOfVoxels(), 0);
+	for (std::size_t i = 0; i < indices.size(); i++) {
+		tensor[indices[i]] = float(values[i] * grid.getStep());
+	}
+}
+
+OTPCVoxelReader::OTPCVoxelReader(const std::filesystem::path& filePathArg) :
+	filePath(filePathArg),
+	file(filePathArg, std::ios_base::in | std::ios_base::binary)
+{
+	char magic[sizeof(headerMagic)];
+	file.read(magic, sizeof(magic));
+	if (!file || std::memcmp(magic, headerMagic, sizeof(magic)) != 0 || readValue<uint32_t>(file) != voxelVersion) {
+		std::cout << "Not a voxel file " << filePath << _endl_;
+		exit(1);
+	}
+	std::array<uint32_t, 3> shape;
+	std::array<double, 3> lower, upper;
+	for (auto& size : shape) {
+		size = readValue<uint32_t>(file);
+	}
+	for (auto corner : { &lower, &upper }) {
+		for (auto& coordinate : *corner) {
+			coordinate = readValue<double>(file);
+		}
+	}
+	auto step = readValue<double>(file);
+	labelNames.resize(readValue<uint32_t>(file));
+	for (auto& labelName : labelNames) {
+		labelName.resize(readValue<uint16_t>(file));
+		file.read(labelName.data(), labelName.size());
+	}
+	if (!file) {
+		std::cout << "Voxel file header is damaged " << filePath << _endl_;
+		exit(1);
+	}
+	grid = OTPCVoxelGrid(shape, lower, upper, step);
+}
+
+const OTPCVoxelGrid& OTPCVoxelReader::getGrid() const {
+	return grid;
+}
+
+const std::vector<std::string>& OTPCVoxelReader::getLabelNames() const {
+	return labelNames;
+}
+
+bool OTPCVoxelReader::readBlock() {
+	char magic[sizeof(blockMagic)];
+	file.read(magic, sizeof(magic));
+	auto events = readValue<uint32_t>(file);
+	auto rawSize = readValue<uint64_t>(file);
+	auto compressedSize = readValue<uint64_t>(file);
+	auto crc = readValue<uint32_t>(file);
+	// end of file, or a block cut off by an interrupted job
+	if (!file || std::memcmp(magic, blockMagic, sizeof(magic)) != 0) {
+		return false;
+	}
+	std::vector<char> compressed(compressedSize);
+	file.read(compressed.data(), compressed.size());
+	if (!file) {
+		return false;
+	}
+	block.resize(rawSize);
+	uLongf uncompressedSize = uLongf(rawSize);
+	if (uncompress((Bytef*)block.data(), &uncompressedSize, (const Bytef*)compressed.data(), uLong(compressedSize)) != Z_OK ||
+		uncompressedSize != rawSize || crc32(0, (const Bytef*)block.data(), uInt(block.size())) != crc) {
+		std::cout << "Voxel block is damaged " << filePath << _endl_;
+		exit(1);
+	}
+	blockPosition = 0;
+	blockEvents = events;
+	return true;
+}
+
+bool OTPCVoxelReader::next(OTPCVoxelEvent& event) {
+	while (blockEvents == 0) {
+		if (!readBlock()) {
+			return false;
+		}
+	}
+	blockEvents--;
+	uint32_t voxels = 0;
+	event.labels.resize(labelNames.size());
+	bool complete =
+		takeValues(block, blockPosition, &event.eventNumber, 1) &&
+		takeValues(block, blockPosition, &event.energy, 1) &&
+		takeValues(block, blockPosition, event.labels.data(), event.labels.size()) &&
+		takeValues(block, blockPosition, &voxels, 1);
+	event.indices.resize(voxels);
+	event.values.resize(voxels);
+	complete = complete &&
+		takeValues(block, blockPosition, event.indices.data(), voxels) &&
+		takeValues(block, blockPosition, event.values.data(), voxels);
+	if (!complete) {
+		std::cout << "Voxel block is damaged " << filePath << _endl_;
+		exit(1);
+	}
+	for (std::size_t i = 1; i < event.indices.size(); i++) {
+		event.indices[i] += event.indices[i - 1];
+	}
+	return true;
+}